@@ -123,9 +123,9 @@
 
 // Default values which the driver needs in order to work correctly
 
-// Mode set to 32-bit
+// Mode set to 16-bit (1ms period fits, compare channel 1 places sub-millisecond events)
 #ifndef CONF_TC3_MODE
-#define CONF_TC3_MODE TC_CTRLA_MODE_COUNT32_Val
+#define CONF_TC3_MODE TC_CTRLA_MODE_COUNT16_Val
 #endif
 
 // CC 1 register set to 0
@@ -133,7 +133,7 @@
 #define CONF_TC3_CC1 0
 #endif
 
-// Not used in 32-bit mode
+// Not used in 16-bit mode
 #define CONF_TC3_PER 0
 
 // Calculating correct top value based on requested tick interval.
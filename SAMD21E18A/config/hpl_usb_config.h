@@ -60,7 +60,7 @@
 // <i> The number of physical endpoints - 1
 // <id> usbd_arch_max_ep_n
 #ifndef CONF_USB_D_MAX_EP_N
-#define CONF_USB_D_MAX_EP_N CONF_USB_N_1
+#define CONF_USB_D_MAX_EP_N CONF_USB_N_3
 #endif
 
 // <y> USB Speed Limit
@@ -100,7 +100,7 @@
 // <1024=> Cached by 1024 bytes buffer (interrupt or isochronous EP)
 // <id> usb_arch_ep1_cache
 #ifndef CONF_USB_EP1_CACHE
-#define CONF_USB_EP1_CACHE 0
+#define CONF_USB_EP1_CACHE 128
 #endif
 
 // <o> Cache buffer size for EP1 IN
@@ -120,6 +120,14 @@
 #ifndef CONF_USB_EP1_I_CACHE
 #define CONF_USB_EP1_I_CACHE 0
 #endif
+
+// <q> Dual bank (ping-pong) for EP1
+// <i> Both hardware banks are used by the one direction of EP1 that is in use, the other direction of EP1 must stay unused.
+// <i> The cache of that direction must hold two max size packets. Reception (or transmission) of next packet then overlaps processing of current packet.
+// <id> usb_arch_ep1_dbk
+#ifndef CONF_USB_EP1_DBK
+#define CONF_USB_EP1_DBK 1
+#endif
 // </h>
 
 // <h> Cache configuration EP2
@@ -158,6 +166,14 @@
 #ifndef CONF_USB_EP2_I_CACHE
 #define CONF_USB_EP2_I_CACHE 0
 #endif
+
+// <q> Dual bank (ping-pong) for EP2
+// <i> Both hardware banks are used by the one direction of EP2 that is in use, the other direction of EP2 must stay unused.
+// <i> The cache of that direction must hold two max size packets. Reception (or transmission) of next packet then overlaps processing of current packet.
+// <id> usb_arch_ep2_dbk
+#ifndef CONF_USB_EP2_DBK
+#define CONF_USB_EP2_DBK 0
+#endif
 // </h>
 
 // <h> Cache configuration EP3
@@ -196,6 +212,14 @@
 #ifndef CONF_USB_EP3_I_CACHE
 #define CONF_USB_EP3_I_CACHE 0
 #endif
+
+// <q> Dual bank (ping-pong) for EP3
+// <i> Both hardware banks are used by the one direction of EP3 that is in use, the other direction of EP3 must stay unused.
+// <i> The cache of that direction must hold two max size packets. Reception (or transmission) of next packet then overlaps processing of current packet.
+// <id> usb_arch_ep3_dbk
+#ifndef CONF_USB_EP3_DBK
+#define CONF_USB_EP3_DBK 0
+#endif
 // </h>
 
 // <h> Cache configuration EP4
@@ -234,6 +258,14 @@
 #ifndef CONF_USB_EP4_I_CACHE
 #define CONF_USB_EP4_I_CACHE 0
 #endif
+
+// <q> Dual bank (ping-pong) for EP4
+// <i> Both hardware banks are used by the one direction of EP4 that is in use, the other direction of EP4 must stay unused.
+// <i> The cache of that direction must hold two max size packets. Reception (or transmission) of next packet then overlaps processing of current packet.
+// <id> usb_arch_ep4_dbk
+#ifndef CONF_USB_EP4_DBK
+#define CONF_USB_EP4_DBK 0
+#endif
 // </h>
 
 // <h> Cache configuration EP5
@@ -272,6 +304,14 @@
 #ifndef CONF_USB_EP5_I_CACHE
 #define CONF_USB_EP5_I_CACHE 0
 #endif
+
+// <q> Dual bank (ping-pong) for EP5
+// <i> Both hardware banks are used by the one direction of EP5 that is in use, the other direction of EP5 must stay unused.
+// <i> The cache of that direction must hold two max size packets. Reception (or transmission) of next packet then overlaps processing of current packet.
+// <id> usb_arch_ep5_dbk
+#ifndef CONF_USB_EP5_DBK
+#define CONF_USB_EP5_DBK 0
+#endif
 // </h>
 
 // <h> Cache configuration EP6
@@ -310,6 +350,14 @@
 #ifndef CONF_USB_EP6_I_CACHE
 #define CONF_USB_EP6_I_CACHE 0
 #endif
+
+// <q> Dual bank (ping-pong) for EP6
+// <i> Both hardware banks are used by the one direction of EP6 that is in use, the other direction of EP6 must stay unused.
+// <i> The cache of that direction must hold two max size packets. Reception (or transmission) of next packet then overlaps processing of current packet.
+// <id> usb_arch_ep6_dbk
+#ifndef CONF_USB_EP6_DBK
+#define CONF_USB_EP6_DBK 0
+#endif
 // </h>
 
 // <h> Cache configuration EP7
@@ -348,6 +396,14 @@
 #ifndef CONF_USB_EP7_I_CACHE
 #define CONF_USB_EP7_I_CACHE 0
 #endif
+
+// <q> Dual bank (ping-pong) for EP7
+// <i> Both hardware banks are used by the one direction of EP7 that is in use, the other direction of EP7 must stay unused.
+// <i> The cache of that direction must hold two max size packets. Reception (or transmission) of next packet then overlaps processing of current packet.
+// <id> usb_arch_ep7_dbk
+#ifndef CONF_USB_EP7_DBK
+#define CONF_USB_EP7_DBK 0
+#endif
 // </h>
 
 // <<< end of configuration section >>>
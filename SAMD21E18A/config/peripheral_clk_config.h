@@ -33,7 +33,7 @@
 
 // <i> Select the clock source for TC.
 #ifndef CONF_GCLK_TC3_SRC
-#define CONF_GCLK_TC3_SRC GCLK_CLKCTRL_GEN_GCLK0_Val
+#define CONF_GCLK_TC3_SRC GCLK_CLKCTRL_GEN_GCLK2_Val
 #endif
 
 /**
@@ -65,7 +65,7 @@
 
 // <i> Select the clock source for USB.
 #ifndef CONF_GCLK_USB_SRC
-#define CONF_GCLK_USB_SRC GCLK_CLKCTRL_GEN_GCLK0_Val
+#define CONF_GCLK_USB_SRC GCLK_CLKCTRL_GEN_GCLK2_Val
 #endif
 
 /**
@@ -224,7 +224,7 @@
 // <id> usb_hid_generic_intin_epaddr
 // <i> Please make sure that the setting here is coincide with the endpoint setting in USB device driver.
 #ifndef CONF_USB_HID_GENERIC_INTIN_EPADDR
-#define CONF_USB_HID_GENERIC_INTIN_EPADDR 0x81
+#define CONF_USB_HID_GENERIC_INTIN_EPADDR 0x82
 #endif
 
 // <o> INTERRUPT IN Endpoint wMaxPacketSize
@@ -235,7 +235,14 @@
 // <id> usb_hid_generic_intin_maxpksz
 // <i> Please make sure that the setting here is coincide with the endpoint setting in USB device driver.
 #ifndef CONF_USB_HID_GENERIC_INTIN_MAXPKSZ
-#define CONF_USB_HID_GENERIC_INTIN_MAXPKSZ 0x8
+#define CONF_USB_HID_GENERIC_INTIN_MAXPKSZ 0x40
+#endif
+
+// <o> INTERRUPT IN Endpoint bInterval <1-255>
+// <i> Polling interval in frames (ms).
+// <id> usb_hid_generic_intin_binterval
+#ifndef CONF_USB_HID_GENERIC_INTIN_BINTERVAL
+#define CONF_USB_HID_GENERIC_INTIN_BINTERVAL 10
 #endif
 
 // <o> INTERRUPT OUT Endpoint Address
@@ -260,7 +267,75 @@
 // <id> usb_hid_generic_intout_maxpksz
 // <i> Please make sure that the setting here is coincide with the endpoint setting in USB device driver.
 #ifndef CONF_USB_HID_GENERIC_INTOUT_MAXPKSZ
-#define CONF_USB_HID_GENERIC_INTOUT_MAXPKSZ 0x8
+#define CONF_USB_HID_GENERIC_INTOUT_MAXPKSZ 0x40
+#endif
+
+// <o> INTERRUPT OUT Endpoint bInterval <1-255>
+// <i> Polling interval in frames (ms), 1 gives one 64-byte report per frame.
+// <id> usb_hid_generic_intout_binterval
+#ifndef CONF_USB_HID_GENERIC_INTOUT_BINTERVAL
+#define CONF_USB_HID_GENERIC_INTOUT_BINTERVAL 1
+#endif
+
+// </h>
+
+// ---- USB Device Stack Vendor Bulk Options ----
+
+// <h> Vendor Bulk Interface Descriptor
+
+// <o> bInterfaceNumber <0x00-0xFF>
+// <i> Interface follows the HID generic interface in the composite configuration.
+// <id> usb_vendor_bifcnum
+#ifndef CONF_USB_VENDOR_BIFCNUM
+#define CONF_USB_VENDOR_BIFCNUM 0x1
+#endif
+
+// <o> BULK IN Endpoint Address
+// <0x81=> EndpointAddress = 0x81
+// <0x82=> EndpointAddress = 0x82
+// <0x83=> EndpointAddress = 0x83
+// <0x84=> EndpointAddress = 0x84
+// <0x85=> EndpointAddress = 0x85
+// <0x86=> EndpointAddress = 0x86
+// <0x87=> EndpointAddress = 0x87
+// <id> usb_vendor_bulkin_epaddr
+// <i> Please make sure that the setting here is coincide with the endpoint setting in USB device driver.
+#ifndef CONF_USB_VENDOR_BULKIN_EPADDR
+#define CONF_USB_VENDOR_BULKIN_EPADDR 0x83
+#endif
+
+// <o> BULK IN Endpoint wMaxPacketSize
+// <0x0008=> 8 bytes
+// <0x0010=> 16 bytes
+// <0x0020=> 32 bytes
+// <0x0040=> 64 bytes
+// <id> usb_vendor_bulkin_maxpksz
+#ifndef CONF_USB_VENDOR_BULKIN_MAXPKSZ
+#define CONF_USB_VENDOR_BULKIN_MAXPKSZ 0x40
+#endif
+
+// <o> BULK OUT Endpoint Address
+// <0x01=> EndpointAddress = 0x01
+// <0x02=> EndpointAddress = 0x02
+// <0x03=> EndpointAddress = 0x03
+// <0x04=> EndpointAddress = 0x04
+// <0x05=> EndpointAddress = 0x05
+// <0x06=> EndpointAddress = 0x06
+// <0x07=> EndpointAddress = 0x07
+// <id> usb_vendor_bulkout_epaddr
+// <i> Please make sure that the setting here is coincide with the endpoint setting in USB device driver.
+#ifndef CONF_USB_VENDOR_BULKOUT_EPADDR
+#define CONF_USB_VENDOR_BULKOUT_EPADDR 0x3
+#endif
+
+// <o> BULK OUT Endpoint wMaxPacketSize
+// <0x0008=> 8 bytes
+// <0x0010=> 16 bytes
+// <0x0020=> 32 bytes
+// <0x0040=> 64 bytes
+// <id> usb_vendor_bulkout_maxpksz
+#ifndef CONF_USB_VENDOR_BULKOUT_MAXPKSZ
+#define CONF_USB_VENDOR_BULKOUT_MAXPKSZ 0x40
 #endif
 
 // </h>
@@ -1,6 +1,794 @@
+#include "..\..\GlowDecompiler\public_api.h"
 #include "driver_init.h"
+#include <hpl_pm_base.h>
+#include <string.h>
+#include "flash_handler.h"
+#include "lz_decoder.h"
+
+#define NVM_ROW_SZ (NVMCTRL_PAGE_SIZE * NVMCTRL_ROW_PAGES)
+#define NVM_JOB_QUEUE_SZ 32    // power of 2, holds all jobs of NVM_ROW_BUFFERS staged rows.
+#define NVM_ROW_BUFFERS 2    // a row is staged while the previous one is programmed.
+#define NVM_STATUS_ERRORS (NVMCTRL_STATUS_PROGE | NVMCTRL_STATUS_LOCKE | NVMCTRL_STATUS_NVME)
+#define NVM_INDEX_ADDR NVM_BUF_START_ADDR    // first two rows of animation region, programmed alternately.
+#define NVM_INDEX_ROWS 2
+#define NVM_INDEX_MAGIC 0x3258444E    // "NDX2".
+#define NVM_SLOT_START_ADDR (NVM_BUF_START_ADDR + NVM_INDEX_ROWS * NVM_ROW_SZ)    // slots are row-aligned and follow the index.
+#define NVM_DSU_WP (1 << 1)    // pac1 write protection bit of dsu (set after reset).
+#define NVM_SLOT_EMPTY 0xFFFFFFFF    // address of unused (erased) index entry.
+#define NVM_SLOT_COMPRESSED 0x01    // stored in lz_decoder.h format.
+#define FLASH_LZ_SCRATCH_SZ 64    // decoded bytes discarded per step when seeking forward.
+#define FLASH_LZ_POS_NONE 0xFFFFFFFF    // no loop-back position.
+
+// Asynchronous nvm job queue (jobs are started from the nvmctrl ready interrupt):
+static struct NvmJob _nvmJobQueue[NVM_JOB_QUEUE_SZ];
+static volatile uint8_t _nvmJobHead;    // next free queue slot (written by producer).
+static volatile uint8_t _nvmJobTail;    // current/next job to execute (written by nvm engine).
+static volatile bool _isNvmJobActive;    // nvm command of job at tail is executing.
+static volatile uint16_t _u16NvmJobErrorCount;    // failed commands and verify mismatches since last NvmWriterBegin().
+
+// Streaming nvm writer (rows are erased once, pages are programmed as they fill):
+struct NvmRowBuffer
+{
+    uint8_t data[NVM_ROW_SZ];
+    volatile uint8_t pendingJobs;    // queued jobs still referencing row data.
+};
+
+static struct NvmRowBuffer _nvmRowBuffers[NVM_ROW_BUFFERS];
+static struct NvmRowBuffer *_ptrNvmRow = &_nvmRowBuffers[0];    // staged row.
+static uint8_t _nvmRowBufferIdx;
+static uint32_t _nvmRowAddr;    // start address of staged row.
+static uint16_t _nvmRowFill;    // number of staged bytes from start of row.
+static uint16_t _nvmRowProgrammed;    // number of bytes from start of row already queued for programming (page multiple).
+static bool _isNvmRowErased;
+static uint16_t _u16NvmEraseCount;    // row erases since last NvmWriterBegin().
+
+// Sequential nvm stream (cursor into mapped animation region):
+static const uint8_t *_ptrFlashStream;
+static const uint8_t *_ptrFlashStreamEnd;
+
+// Active slot (the decoder addresses an animation from NVM_BUF_START_ADDR, reads are moved to its slot):
+static uint32_t _u32FlashSlotAddr = NVM_SLOT_START_ADDR;
+
+// Compressed animation (decoder addresses are positions in the decompressed stream):
+static bool _isFlashCompressed;
+static uint32_t _u32FlashStoredLength;    // compressed bytes from _u32FlashSlotAddr.
+static uint32_t _u32FlashRawLength;
+static struct LzState _flashLz;    // position of sequential reads.
+static struct LzState _flashLzLoop;    // saved at loop-back hint, backward seeks resume here.
+static uint32_t _u32FlashLzLoopPos = FLASH_LZ_POS_NONE;
+static bool _isFlashLzLoopSaved;
+static uint16_t _u16FlashLzRestarts;    // backward seeks that decoded from the start again.
+
+// Animation library index (an index row holds one entry per slot, a copy is kept in sram and every change is programmed
+// into the other index row, so a power loss while programming leaves the previous index):
+struct NvmSlotInfo
+{
+    uint32_t addr;    // row-aligned start or NVM_SLOT_EMPTY.
+    uint32_t length;    // stored bytes.
+    uint32_t crc;    // NvmCrc32() of stored bytes.
+    uint32_t flags;
+    uint32_t rawLength;    // decompressed bytes (equals length if not compressed).
+    uint32_t nameHash;    // chosen by host.
+};
+
+struct NvmSlotIndex
+{
+    uint32_t magic;    // in first page, programmed last.
+    uint32_t sequence;    // the valid row with the higher sequence is current.
+    uint8_t bootSlot;    // slot played after reset or NVM_SLOT_NONE.
+    uint8_t reserved[7];
+    struct NvmSlotInfo slots[NVM_SLOTS];    // fills the 256-byte row.
+};
+
+static union
+{
+    struct NvmSlotIndex index;
+    uint8_t data[NVM_ROW_SZ];
+} _nvmIndexRow;
+
+static volatile uint8_t _u8NvmIndexJobs;    // queued jobs still referencing _nvmIndexRow.
+static uint8_t _u8NvmIndexRowIdx;    // index row holding the current index.
+static uint8_t _u8NvmActiveSlot = NVM_SLOT_NONE;    // slot played from nvm.
+static uint32_t _u32NvmAppendLimit;    // end of free gap chosen by NvmAppendBegin().
+
+#pragma region Nvm mapped reads
+
+// Translate decoder address to nvm address within the active slot:
+static uint32_t FlashSlotAddr(uint32_t addr)
+{
+    return addr - NVM_BUF_START_ADDR + _u32FlashSlotAddr;
+}
+
+// Check that length bytes from nvm address addr lie within the slot rows of the animation region (NVM_BUF_END_ADDR is exclusive):
+static bool IsSlotRange(uint32_t addr, uint32_t length)
+{
+    return addr >= NVM_SLOT_START_ADDR && addr <= NVM_BUF_END_ADDR && length <= NVM_BUF_END_ADDR - addr;
+}
+
+// Check that length bytes from nvm address addr lie between the active slot and the end of the animation region (NVM_BUF_END_ADDR is exclusive):
+static bool IsFlashRange(uint32_t addr, uint32_t length)
+{
+    return addr >= _u32FlashSlotAddr && addr <= NVM_BUF_END_ADDR && length <= NVM_BUF_END_ADDR - addr;
+}
+
+// Returns pointer to length bytes of mapped nvm at decoder address addr (read in place), NULL if out of animation region.
+// Valid until the region is reprogrammed:
+const uint8_t *FlashMap(uint32_t addr, uint32_t length)
+{
+    addr = FlashSlotAddr(addr);
+    if (_isFlashCompressed || !IsFlashRange(addr, length)) return NULL;    // compressed data has no mapped view.
+    return (const uint8_t *)addr;
+}
+
+// Position stream cursor at decoder address addr for sequential reads with FlashStreamNext():
+bool FlashStreamSeek(uint32_t addr)
+{
+    addr = FlashSlotAddr(addr);
+    if (_isFlashCompressed || !IsFlashRange(addr, 0)) return false;
+
+    _ptrFlashStream = (const uint8_t *)addr;
+    _ptrFlashStreamEnd = (const uint8_t *)NVM_BUF_END_ADDR;
+    return true;
+}
+
+// Returns pointer to next length bytes of stream and advances cursor, NULL at end of region (cursor is kept):
+const uint8_t *FlashStreamNext(uint32_t length)
+{
+    const uint8_t *ptr = _ptrFlashStream;
+
+    if (length > (uint32_t)(_ptrFlashStreamEnd - ptr)) return NULL;
+    _ptrFlashStream = ptr + length;
+    return ptr;
+}
+
+// Returns decoder address of stream cursor:
+uint32_t GetFlashStreamAddr(void)
+{
+    return (uint32_t)_ptrFlashStream - _u32FlashSlotAddr + NVM_BUF_START_ADDR;
+}
+
+// Copy length bytes (rounded up to words) from word-aligned mapped nvm of any slot, returns sum of copied words.
+// Pass a NULL destination to only compute the sum:
+uint32_t FlashCopyWords(uint32_t *ptrDst, uint32_t srcAddr, uint32_t length)
+{
+    const uint32_t *ptrSrc = (const uint32_t *)srcAddr;
+    uint32_t words = (length + 3) / 4;
+    uint32_t sum = 0;
+
+    if (!IsSlotRange(srcAddr, words * 4)) return 0;
+
+    // Unrolled by 4 (one nvm cache line):
+    while (words >= 4)
+    {
+        uint32_t w0 = ptrSrc[0], w1 = ptrSrc[1], w2 = ptrSrc[2], w3 = ptrSrc[3];
+        if (ptrDst)
+        {
+            ptrDst[0] = w0;
+            ptrDst[1] = w1;
+            ptrDst[2] = w2;
+            ptrDst[3] = w3;
+            ptrDst += 4;
+        }
+        sum += w0 + w1 + w2 + w3;
+        ptrSrc += 4;
+        words -= 4;
+    }
+    while (words--)
+    {
+        if (ptrDst) *ptrDst++ = *ptrSrc;
+        sum += *ptrSrc++;
+    }
+
+    return sum;
+}
+
+#pragma endregion
+
+#pragma region Nvm animation reads
+
+// Decoder hint: address the animation jumps back to on repeat (decompression state is saved when passing it, mapped
+// reads need no hint):
+void FlashSetLoopHint(uint32_t addr)
+{
+    if (!_isFlashCompressed) return;
+
+    _u32FlashLzLoopPos = addr - NVM_BUF_START_ADDR;
+    _isFlashLzLoopSaved = false;
+}
+
+// Move reads to the active slot, rewind decompression of a compressed animation and clear its hint (animation start):
+void FlashReadReset(void)
+{
+    _u32FlashSlotAddr = GetNvmAnimationLength() ? GetNvmAnimationAddr() : NVM_SLOT_START_ADDR;
+
+    _isFlashCompressed = IsNvmAnimationCompressed();
+    _u32FlashStoredLength = GetNvmAnimationLength();
+    _u32FlashRawLength = GetNvmAnimationRawLength();
+    LzInit(&_flashLz);
+    _u32FlashLzLoopPos = FLASH_LZ_POS_NONE;
+    _isFlashLzLoopSaved = false;
+    _u16FlashLzRestarts = 0;
+}
+
+// Decompress next length bytes of stored animation, saving decoder state when passing the loop-back position:
+static uint32_t FlashLzRead(uint8_t *buffer, uint32_t length)
+{
+    const uint8_t *ptrIn = (const uint8_t *)_u32FlashSlotAddr + _flashLz.inPos;
+    const uint8_t *ptrInEnd = (const uint8_t *)_u32FlashSlotAddr + _u32FlashStoredLength;
+    uint32_t produced = 0;
+
+    if (!_isFlashLzLoopSaved && _u32FlashLzLoopPos >= _flashLz.outPos && _u32FlashLzLoopPos < _flashLz.outPos + length)
+    {
+        produced = LzDecode(&_flashLz, &ptrIn, ptrInEnd, buffer, _u32FlashLzLoopPos - _flashLz.outPos);
+        _flashLzLoop = _flashLz;
+        _isFlashLzLoopSaved = true;
+    }
+    return produced + LzDecode(&_flashLz, &ptrIn, ptrInEnd, buffer + produced, length - produced);
+}
+
+// Move decompression to rawPos (backward seeks resume from the loop-back state or the start):
+static void FlashLzSeek(uint32_t rawPos)
+{
+    uint8_t scratch[FLASH_LZ_SCRATCH_SZ];
+
+    if (rawPos < _flashLz.outPos)
+    {
+        if (_isFlashLzLoopSaved && _flashLzLoop.outPos <= rawPos)
+        {
+            _flashLz = _flashLzLoop;
+        }
+        else
+        {
+            LzInit(&_flashLz);
+            _u16FlashLzRestarts++;
+        }
+    }
+
+    while (_flashLz.outPos < rawPos)
+    {
+        uint32_t length = rawPos - _flashLz.outPos;
+        if (length > FLASH_LZ_SCRATCH_SZ) length = FLASH_LZ_SCRATCH_SZ;
+        if (!FlashLzRead(scratch, length)) break;    // truncated stream.
+    }
+}
+
+uint16_t GetFlashLzRestarts(void)
+{
+    return _u16FlashLzRestarts;
+}
 
 void FlashRead(uint32_t src_addr, uint8_t *buffer, uint32_t length)
 {
+    // Decompress compressed animation on demand (sequential reads continue the stream):
+    if (_isFlashCompressed && src_addr >= NVM_BUF_START_ADDR && src_addr - NVM_BUF_START_ADDR < _u32FlashRawLength)
+    {
+        uint32_t rawPos = src_addr - NVM_BUF_START_ADDR;
+        if (length > _u32FlashRawLength - rawPos) length = _u32FlashRawLength - rawPos;
+
+        if (rawPos != _flashLz.outPos) FlashLzSeek(rawPos);
+        FlashLzRead(buffer, length);
+        return;
+    }
+
+    // Nvm is memory-mapped, copy animation reads directly (an sram line cache in front of it only adds a copy):
+    if (src_addr >= NVM_BUF_START_ADDR && IsFlashRange(FlashSlotAddr(src_addr), length))
+    {
+        memcpy(buffer, (const void *)FlashSlotAddr(src_addr), length);
+        return;
+    }
 	flash_read(&FLASH_0, src_addr, buffer, length);    // read first 14 bytes.
-}
\ No newline at end of file
+}
+
+#pragma endregion
+
+#pragma region Nvm job engine
+
+// Issue nvm command of job at queue tail (verify jobs complete immediately). Called from nvm interrupt or with interrupts masked:
+static void NvmStartNextJob(void)
+{
+    while (_nvmJobTail != _nvmJobHead)
+    {
+        struct NvmJob *ptrJob = &_nvmJobQueue[_nvmJobTail];
+
+        if (ptrJob->type == NvmJobVerifyPage)
+        {
+            bool isOk = !memcmp((const void *)ptrJob->addr, ptrJob->ptrData, NVMCTRL_PAGE_SIZE);
+            if (!isOk) _u16NvmJobErrorCount++;
+            if (ptrJob->doneCallback) ptrJob->doneCallback(ptrJob, isOk);
+            _nvmJobTail = (_nvmJobTail + 1) & (NVM_JOB_QUEUE_SZ - 1);
+            continue;
+        }
+
+        if (ptrJob->type == NvmJobWritePage)
+        {
+            // Clear page buffer (completes within a few cycles):
+            hri_nvmctrl_write_CTRLA_reg(NVMCTRL, NVMCTRL_CTRLA_CMD_PBC | NVMCTRL_CTRLA_CMDEX_KEY);
+            while (!hri_nvmctrl_get_interrupt_READY_bit(NVMCTRL));
+
+            // Fill page buffer (16-bit writes only):
+            volatile uint16_t *ptrPageBuffer = &NVM_MEMORY[ptrJob->addr / 2];
+            uint8_t i;
+            for (i = 0; i < NVMCTRL_PAGE_SIZE; i += 2)
+            {
+                *ptrPageBuffer++ = ptrJob->ptrData[i] | (ptrJob->ptrData[i + 1] << 8);
+            }
+        }
+
+        hri_nvmctrl_clear_STATUS_reg(NVMCTRL, NVMCTRL_STATUS_MASK);
+        hri_nvmctrl_write_ADDR_reg(NVMCTRL, ptrJob->addr / 2);
+        hri_nvmctrl_write_CTRLA_reg(NVMCTRL, (ptrJob->type == NvmJobEraseRow ? NVMCTRL_CTRLA_CMD_ER : NVMCTRL_CTRLA_CMD_WP) | NVMCTRL_CTRLA_CMDEX_KEY);
+
+        // Completion is signalled by ready interrupt:
+        _isNvmJobActive = true;
+        hri_nvmctrl_set_INTEN_READY_bit(NVMCTRL);
+        return;
+    }
+
+    // Queue drained (ready flag stays set while idle, so interrupt must be disabled):
+    _isNvmJobActive = false;
+    hri_nvmctrl_clear_INTEN_READY_bit(NVMCTRL);
+}
+
+// Complete executing job and start next one:
+static void NvmFinishJob(void)
+{
+    struct NvmJob *ptrJob = &_nvmJobQueue[_nvmJobTail];
+
+    bool isOk = !(hri_nvmctrl_read_STATUS_reg(NVMCTRL) & NVM_STATUS_ERRORS);
+    if (!isOk) _u16NvmJobErrorCount++;
+    if (ptrJob->doneCallback) ptrJob->doneCallback(ptrJob, isOk);
+
+    _nvmJobTail = (_nvmJobTail + 1) & (NVM_JOB_QUEUE_SZ - 1);
+    NvmStartNextJob();
+}
+
+static void NvmReadyCallback(struct flash_descriptor *const descr)
+{
+    (void)descr;
+    // Ignore stale interrupt of a job already finished by NvmPollJobs():
+    if (_isNvmJobActive && hri_nvmctrl_get_interrupt_READY_bit(NVMCTRL)) NvmFinishJob();
+}
+
+void NvmJobsInit(void)
+{
+    flash_register_callback(&FLASH_0, FLASH_CB_READY, NvmReadyCallback);
+    hri_nvmctrl_clear_INTEN_READY_bit(NVMCTRL);    // enabled only while a job is executing.
+}
+
+// Queue job (copied), returns false if queue is full:
+bool NvmQueueJob(const struct NvmJob *ptrJob)
+{
+    bool isQueued = false;
+
+    CRITICAL_SECTION_ENTER();
+    uint8_t nextHead = (_nvmJobHead + 1) & (NVM_JOB_QUEUE_SZ - 1);
+    if (nextHead != _nvmJobTail)
+    {
+        _nvmJobQueue[_nvmJobHead] = *ptrJob;
+        _nvmJobHead = nextHead;
+        if (!_isNvmJobActive) NvmStartNextJob();
+        isQueued = true;
+    }
+    CRITICAL_SECTION_LEAVE();
+
+    return isQueued;
+}
+
+// Advance queue without the nvm interrupt (for waits from interrupt context of equal priority):
+void NvmPollJobs(void)
+{
+    CRITICAL_SECTION_ENTER();
+    if (_isNvmJobActive && hri_nvmctrl_get_interrupt_READY_bit(NVMCTRL)) NvmFinishJob();
+    CRITICAL_SECTION_LEAVE();
+}
+
+bool IsNvmBusy(void)
+{
+    return _nvmJobTail != _nvmJobHead;
+}
+
+uint16_t GetNvmJobErrorCount(void)
+{
+    return _u16NvmJobErrorCount;
+}
+
+#pragma endregion
+
+#pragma region Nvm streaming writer
+
+static void NvmWriterJobDone(const struct NvmJob *ptrJob, bool isOk)
+{
+    (void)isOk;
+    ((struct NvmRowBuffer *)ptrJob->ptrContext)->pendingJobs--;
+}
+
+static void NvmWriterQueueJob(enum NvmJobType type, uint32_t addr, const uint8_t *ptrData)
+{
+    struct NvmJob job = {type, addr, ptrData, NvmWriterJobDone, _ptrNvmRow};
+
+    CRITICAL_SECTION_ENTER();
+    _ptrNvmRow->pendingJobs++;
+    CRITICAL_SECTION_LEAVE();
+
+    while (!NvmQueueJob(&job)) NvmPollJobs();
+}
+
+static void NvmWriterStageRow(uint32_t rowAddr)
+{
+    // Switch to next row buffer, waiting until its previous row has been programmed:
+    _nvmRowBufferIdx = (_nvmRowBufferIdx + 1) % NVM_ROW_BUFFERS;
+    _ptrNvmRow = &_nvmRowBuffers[_nvmRowBufferIdx];
+    while (_ptrNvmRow->pendingJobs) NvmPollJobs();
+
+    _nvmRowAddr = rowAddr;
+    _nvmRowFill = 0;
+    _nvmRowProgrammed = 0;
+    _isNvmRowErased = false;
+    memset(_ptrNvmRow->data, 0xFF, NVM_ROW_SZ);
+}
+
+// Queue staged pages of current row up to uptoBytes (page multiple), erasing the row first time round:
+static void NvmWriterProgramPages(uint16_t uptoBytes)
+{
+    if (!_isNvmRowErased)
+    {
+        NvmWriterQueueJob(NvmJobEraseRow, _nvmRowAddr, NULL);
+        _isNvmRowErased = true;
+        _u16NvmEraseCount++;
+    }
+
+    while (_nvmRowProgrammed < uptoBytes)
+    {
+        NvmWriterQueueJob(NvmJobWritePage, _nvmRowAddr + _nvmRowProgrammed, &_ptrNvmRow->data[_nvmRowProgrammed]);
+        NvmWriterQueueJob(NvmJobVerifyPage, _nvmRowAddr + _nvmRowProgrammed, &_ptrNvmRow->data[_nvmRowProgrammed]);
+        _nvmRowProgrammed += NVMCTRL_PAGE_SIZE;
+    }
+}
+
+void NvmWriterBegin(uint32_t dstAddr)
+{
+    uint32_t rowAddr = dstAddr & ~(NVM_ROW_SZ - 1);
+
+    NvmWriterStageRow(rowAddr);
+    _u16NvmEraseCount = 0;
+    _u16NvmJobErrorCount = 0;
+
+    // Preserve row bytes preceding an unaligned start address (they are erased with the row):
+    _nvmRowFill = dstAddr - rowAddr;
+    if (_nvmRowFill) flash_read(&FLASH_0, rowAddr, _ptrNvmRow->data, _nvmRowFill);
+}
+
+void NvmWriterWrite(const uint8_t *ptrData, uint32_t length)
+{
+    while (length)
+    {
+        uint16_t chunkLen = NVM_ROW_SZ - _nvmRowFill;
+        if (chunkLen > length) chunkLen = length;
+
+        memcpy(&_ptrNvmRow->data[_nvmRowFill], ptrData, chunkLen);
+        _nvmRowFill += chunkLen;
+        ptrData += chunkLen;
+        length -= chunkLen;
+
+        // Program completed pages:
+        NvmWriterProgramPages(_nvmRowFill & ~(NVMCTRL_PAGE_SIZE - 1));
+
+        // Move on to next row:
+        if (_nvmRowFill == NVM_ROW_SZ) NvmWriterStageRow(_nvmRowAddr + NVM_ROW_SZ);
+    }
+}
+
+// Check whether length bytes can be written without waiting for a row buffer to be released:
+bool IsNvmWriterReady(uint32_t length)
+{
+    if (_nvmRowFill + length < NVM_ROW_SZ) return true;
+    return !_nvmRowBuffers[(_nvmRowBufferIdx + 1) % NVM_ROW_BUFFERS].pendingJobs;
+}
+
+// Program last partially filled page (remainder of page and row is left erased).
+void NvmWriterFlush(void)
+{
+    if (_nvmRowFill > _nvmRowProgrammed)
+    {
+        NvmWriterProgramPages((_nvmRowFill + NVMCTRL_PAGE_SIZE - 1) & ~(NVMCTRL_PAGE_SIZE - 1));
+    }
+}
+
+uint16_t GetNvmEraseCount(void)
+{
+    return _u16NvmEraseCount;
+}
+
+#pragma endregion
+
+#pragma region Nvm animation library
+
+static const struct NvmSlotInfo *GetNvmSlot(uint8_t slot)
+{
+    if (slot >= NVM_SLOTS || _nvmIndexRow.index.slots[slot].addr == NVM_SLOT_EMPTY) return NULL;
+    return &_nvmIndexRow.index.slots[slot];
+}
+
+// Returns first row following the slot:
+static uint32_t GetNvmSlotEnd(const struct NvmSlotInfo *ptrSlot)
+{
+    return (ptrSlot->addr + ptrSlot->length + NVM_ROW_SZ - 1) & ~(NVM_ROW_SZ - 1);
+}
+
+// Crc32 (ieee 802.3) of word-aligned memory computed by the dsu, returns false on a bus error:
+static bool NvmCrc32(uint32_t addr, uint32_t length, uint32_t *ptrCrc)
+{
+    hri_pac_clear_WP_reg(PAC1, NVM_DSU_WP);
+    hri_dsu_clear_STATUSA_reg(DSU, DSU_STATUSA_DONE | DSU_STATUSA_BERR);
+    hri_dsu_write_DATA_reg(DSU, 0xFFFFFFFF);
+    hri_dsu_write_ADDR_reg(DSU, DSU_ADDR_ADDR(addr >> 2));
+    hri_dsu_write_LENGTH_reg(DSU, DSU_LENGTH_LENGTH((length + 3) >> 2));
+    hri_dsu_write_CTRL_reg(DSU, DSU_CTRL_CRC);
+    while (!hri_dsu_get_STATUSA_DONE_bit(DSU));
+
+    bool isOk = !hri_dsu_get_STATUSA_BERR_bit(DSU);
+    *ptrCrc = ~hri_dsu_read_DATA_reg(DSU);
+    hri_pac_set_WP_reg(PAC1, NVM_DSU_WP);
+    return isOk;
+}
+
+// Load current index row (unformatted or invalid index rows give an empty library, out-of-region slots are dropped):
+void NvmLibraryInit(void)
+{
+    const struct NvmSlotIndex *ptrRows[NVM_INDEX_ROWS];
+    uint8_t i;
+
+    _pm_enable_bus_clock(PM_BUS_APBB, DSU);
+
+    // Pick valid row with the higher sequence (a row torn by a power loss has no magic):
+    _u8NvmIndexRowIdx = NVM_INDEX_ROWS;
+    for (i = 0; i < NVM_INDEX_ROWS; i++)
+    {
+        ptrRows[i] = (const struct NvmSlotIndex *)(NVM_INDEX_ADDR + i * NVM_ROW_SZ);
+        if (ptrRows[i]->magic != NVM_INDEX_MAGIC) continue;
+        if (_u8NvmIndexRowIdx == NVM_INDEX_ROWS || (int32_t)(ptrRows[i]->sequence - ptrRows[_u8NvmIndexRowIdx]->sequence) > 0) _u8NvmIndexRowIdx = i;
+    }
+
+    if (_u8NvmIndexRowIdx < NVM_INDEX_ROWS)
+    {
+        memcpy(_nvmIndexRow.data, ptrRows[_u8NvmIndexRowIdx], NVM_ROW_SZ);
+    }
+    else
+    {
+        memset(_nvmIndexRow.data, 0xFF, NVM_ROW_SZ);    // all slots empty, no boot slot.
+        _nvmIndexRow.index.magic = NVM_INDEX_MAGIC;
+        _nvmIndexRow.index.sequence = 0;
+        _u8NvmIndexRowIdx = 0;
+    }
+
+    for (i = 0; i < NVM_SLOTS; i++)
+    {
+        struct NvmSlotInfo *ptrSlot = &_nvmIndexRow.index.slots[i];
+        if (ptrSlot->addr == NVM_SLOT_EMPTY) continue;
+        if (ptrSlot->addr < NVM_SLOT_START_ADDR || ptrSlot->addr >= NVM_BUF_END_ADDR || ptrSlot->length > NVM_BUF_END_ADDR - ptrSlot->addr)
+        {
+            memset(ptrSlot, 0xFF, sizeof(struct NvmSlotInfo));
+        }
+    }
+
+    _u8NvmActiveSlot = GetNvmSlot(_nvmIndexRow.index.bootSlot) ? _nvmIndexRow.index.bootSlot : NVM_SLOT_NONE;
+}
+
+static void NvmIndexJobDone(const struct NvmJob *ptrJob, bool isOk)
+{
+    (void)ptrJob;
+    (void)isOk;
+    _u8NvmIndexJobs--;
+}
+
+static void NvmQueueIndexJob(enum NvmJobType type, uint16_t offset)
+{
+    uint32_t rowAddr = NVM_INDEX_ADDR + _u8NvmIndexRowIdx * NVM_ROW_SZ;
+    struct NvmJob job = {type, rowAddr + offset, &_nvmIndexRow.data[offset], NvmIndexJobDone, NULL};
+
+    CRITICAL_SECTION_ENTER();
+    _u8NvmIndexJobs++;
+    CRITICAL_SECTION_LEAVE();
+
+    while (!NvmQueueJob(&job)) NvmPollJobs();
+}
+
+// Wait until the index row copy is no longer referenced by queued jobs (before it is modified):
+static void NvmWaitIndexJobs(void)
+{
+    while (_u8NvmIndexJobs) NvmPollJobs();
+}
+
+// Queue programming of the sram index copy into the other index row (slot data is not touched).
+// The first page holding the magic is programmed last, so the row only becomes valid once complete:
+static void NvmWriteIndex(void)
+{
+    uint16_t offset;
+
+    _nvmIndexRow.index.sequence++;
+    _u8NvmIndexRowIdx = (_u8NvmIndexRowIdx + 1) % NVM_INDEX_ROWS;
+
+    NvmQueueIndexJob(NvmJobEraseRow, 0);
+    for (offset = NVMCTRL_PAGE_SIZE; offset <= NVM_ROW_SZ; offset += NVMCTRL_PAGE_SIZE)
+    {
+        NvmQueueIndexJob(NvmJobWritePage, offset % NVM_ROW_SZ);
+        NvmQueueIndexJob(NvmJobVerifyPage, offset % NVM_ROW_SZ);
+    }
+}
+
+// Returns start of free space following addr (addr itself if it lies within a slot):
+static uint32_t GetNvmGapEnd(uint32_t addr)
+{
+    uint32_t gapEnd = NVM_BUF_END_ADDR;
+    uint8_t i;
+
+    for (i = 0; i < NVM_SLOTS; i++)
+    {
+        const struct NvmSlotInfo *ptrSlot = GetNvmSlot(i);
+        if (!ptrSlot) continue;
+        if (ptrSlot->addr <= addr && addr < GetNvmSlotEnd(ptrSlot)) return addr;
+        if (ptrSlot->addr > addr && ptrSlot->addr < gapEnd) gapEnd = ptrSlot->addr;
+    }
+    return gapEnd;
+}
+
+// Pick largest free gap for a new animation (other slots are not moved), returns its row-aligned start.
+// Returns 0 if all index entries are used or no row is free. GetNvmAppendLimit() bounds the upload:
+uint32_t NvmAppendBegin(void)
+{
+    uint32_t appendAddr = 0;
+    uint8_t i;
+
+    _u32NvmAppendLimit = 0;
+    for (i = 0; i < NVM_SLOTS && GetNvmSlot(i); i++);
+    if (i == NVM_SLOTS) return 0;
+
+    // Gaps start at the first slot row or after a slot:
+    for (i = 0; i <= NVM_SLOTS; i++)
+    {
+        uint32_t gapAddr;
+        if (i == NVM_SLOTS) gapAddr = NVM_SLOT_START_ADDR;
+        else if (GetNvmSlot(i)) gapAddr = GetNvmSlotEnd(GetNvmSlot(i));
+        else continue;
+
+        uint32_t gapEnd = GetNvmGapEnd(gapAddr);
+        if (gapEnd - gapAddr > _u32NvmAppendLimit - appendAddr)
+        {
+            appendAddr = gapAddr;
+            _u32NvmAppendLimit = gapEnd;
+        }
+    }
+    return appendAddr;
+}
+
+uint32_t GetNvmAppendLimit(void)
+{
+    return _u32NvmAppendLimit;
+}
+
+// Record animation programmed by an append in a free index entry and make it the active and boot slot
+// (rawLength is the decompressed length of a compressed animation):
+bool NvmAppendFinish(uint32_t addr, uint32_t length, bool isCompressed, uint32_t rawLength, uint32_t nameHash)
+{
+    uint8_t slot;
+
+    if (!length || addr < NVM_SLOT_START_ADDR || addr > _u32NvmAppendLimit || length > _u32NvmAppendLimit - addr) return false;
+    for (slot = 0; slot < NVM_SLOTS && GetNvmSlot(slot); slot++);
+    if (slot == NVM_SLOTS) return false;
+
+    uint32_t crc;
+    if (!NvmCrc32(addr, length, &crc)) return false;
+
+    NvmWaitIndexJobs();
+    struct NvmSlotInfo *ptrSlot = &_nvmIndexRow.index.slots[slot];
+    ptrSlot->addr = addr;
+    ptrSlot->length = length;
+    ptrSlot->crc = crc;
+    ptrSlot->flags = isCompressed ? NVM_SLOT_COMPRESSED : 0;
+    ptrSlot->rawLength = isCompressed ? rawLength : length;
+    ptrSlot->nameHash = nameHash;
+
+    _u8NvmActiveSlot = slot;
+    _nvmIndexRow.index.bootSlot = slot;    // an uploaded animation is played after reset.
+    NvmWriteIndex();
+    return true;
+}
+
+// Make slot the active animation (played by the next start), optionally also after reset (reprograms the index):
+bool NvmSelectSlot(uint8_t slot, bool isBoot)
+{
+    if (!GetNvmSlot(slot)) return false;
+
+    _u8NvmActiveSlot = slot;
+    if (isBoot && _nvmIndexRow.index.bootSlot != slot)
+    {
+        NvmWaitIndexJobs();
+        _nvmIndexRow.index.bootSlot = slot;
+        NvmWriteIndex();
+    }
+    return true;
+}
+
+// Remove slot from index, NVM_SLOT_NONE removes all (rows are reused by later appends):
+bool NvmDeleteSlot(uint8_t slot)
+{
+    if (slot != NVM_SLOT_NONE && !GetNvmSlot(slot)) return false;
+
+    NvmWaitIndexJobs();
+    if (slot == NVM_SLOT_NONE)
+    {
+        memset(_nvmIndexRow.index.slots, 0xFF, sizeof(_nvmIndexRow.index.slots));
+        _u8NvmActiveSlot = NVM_SLOT_NONE;
+        _nvmIndexRow.index.bootSlot = NVM_SLOT_NONE;
+    }
+    else
+    {
+        memset(&_nvmIndexRow.index.slots[slot], 0xFF, sizeof(struct NvmSlotInfo));
+        if (_u8NvmActiveSlot == slot) _u8NvmActiveSlot = NVM_SLOT_NONE;
+        if (_nvmIndexRow.index.bootSlot == slot) _nvmIndexRow.index.bootSlot = NVM_SLOT_NONE;
+    }
+    NvmWriteIndex();
+    return true;
+}
+
+uint8_t GetNvmActiveSlot(void)
+{
+    return _u8NvmActiveSlot;
+}
+
+uint8_t GetNvmBootSlot(void)
+{
+    return _nvmIndexRow.index.bootSlot;
+}
+
+// Returns bit per used slot:
+uint16_t GetNvmSlotMask(void)
+{
+    uint16_t mask = 0;
+    uint8_t i;
+    for (i = 0; i < NVM_SLOTS; i++) if (GetNvmSlot(i)) mask |= 1 << i;
+    return mask;
+}
+
+uint32_t GetNvmSlotNameHash(uint8_t slot)
+{
+    const struct NvmSlotInfo *ptrSlot = GetNvmSlot(slot);
+    return ptrSlot ? ptrSlot->nameHash : 0;
+}
+
+// Active slot (0 if none is selected):
+uint32_t GetNvmAnimationAddr(void)
+{
+    const struct NvmSlotInfo *ptrSlot = GetNvmSlot(_u8NvmActiveSlot);
+    return ptrSlot ? ptrSlot->addr : 0;
+}
+
+uint32_t GetNvmAnimationLength(void)
+{
+    const struct NvmSlotInfo *ptrSlot = GetNvmSlot(_u8NvmActiveSlot);
+    return ptrSlot ? ptrSlot->length : 0;
+}
+
+bool IsNvmAnimationCompressed(void)
+{
+    const struct NvmSlotInfo *ptrSlot = GetNvmSlot(_u8NvmActiveSlot);
+    return ptrSlot && (ptrSlot->flags & NVM_SLOT_COMPRESSED);
+}
+
+// Returns decompressed length:
+uint32_t GetNvmAnimationRawLength(void)
+{
+    const struct NvmSlotInfo *ptrSlot = GetNvmSlot(_u8NvmActiveSlot);
+    return ptrSlot ? ptrSlot->rawLength : 0;
+}
+
+// Check stored bytes of active slot against the crc recorded when it was appended:
+bool IsNvmAnimationIntact(void)
+{
+    const struct NvmSlotInfo *ptrSlot = GetNvmSlot(_u8NvmActiveSlot);
+    uint32_t crc;
+
+    return ptrSlot && NvmCrc32(ptrSlot->addr, ptrSlot->length, &crc) && crc == ptrSlot->crc;
+}
+
+#pragma endregion
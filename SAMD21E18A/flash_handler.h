@@ -0,0 +1,80 @@
+/*
+ *  Copyright 2018-2021 ledmaker.org
+ *
+ *  This file is part of Elektra-SAMD21E18A.
+ *
+ *  Elektra-SAMD21E18A is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License,
+ *  or any later version.
+ *
+ *  Elektra-SAMD21E18A is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Elektra-SAMD21E18A. If not, see https://www.gnu.org/licenses/.
+ */
+
+#ifndef FLASH_HANDLER_H_
+#define FLASH_HANDLER_H_
+
+#define NVM_SLOTS 10    // animation library entries (index rows of 256 bytes).
+#define NVM_SLOT_NONE 0xFF
+
+enum NvmJobType
+{
+    NvmJobEraseRow = 0,
+    NvmJobWritePage = 1,
+    NvmJobVerifyPage = 2
+};
+
+struct NvmJob;
+typedef void (*NvmJobDoneCallback)(const struct NvmJob *ptrJob, bool isOk);    // called from nvm interrupt.
+
+struct NvmJob
+{
+    enum NvmJobType type;
+    uint32_t addr;    // row address (erase) or page address (write/verify).
+    const uint8_t *ptrData;    // page data (write/verify), must remain valid until job is done.
+    NvmJobDoneCallback doneCallback;    // optional.
+    void *ptrContext;
+};
+
+extern void FlashRead(uint32_t src_addr, uint8_t *buffer, uint32_t length);
+extern const uint8_t *FlashMap(uint32_t addr, uint32_t length);
+extern bool FlashStreamSeek(uint32_t addr);
+extern const uint8_t *FlashStreamNext(uint32_t length);
+extern uint32_t GetFlashStreamAddr(void);
+extern void FlashSetLoopHint(uint32_t addr);
+extern void FlashReadReset(void);
+extern uint16_t GetFlashLzRestarts(void);
+extern uint32_t FlashCopyWords(uint32_t *ptrDst, uint32_t srcAddr, uint32_t length);
+extern void NvmJobsInit(void);
+extern bool NvmQueueJob(const struct NvmJob *ptrJob);
+extern void NvmPollJobs(void);
+extern bool IsNvmBusy(void);
+extern uint16_t GetNvmJobErrorCount(void);
+extern void NvmWriterBegin(uint32_t dstAddr);
+extern void NvmWriterWrite(const uint8_t *ptrData, uint32_t length);
+extern bool IsNvmWriterReady(uint32_t length);
+extern void NvmWriterFlush(void);
+extern uint16_t GetNvmEraseCount(void);
+extern void NvmLibraryInit(void);
+extern uint32_t NvmAppendBegin(void);
+extern uint32_t GetNvmAppendLimit(void);
+extern bool NvmAppendFinish(uint32_t addr, uint32_t length, bool isCompressed, uint32_t rawLength, uint32_t nameHash);
+extern bool NvmSelectSlot(uint8_t slot, bool isBoot);
+extern bool NvmDeleteSlot(uint8_t slot);
+extern uint8_t GetNvmActiveSlot(void);
+extern uint8_t GetNvmBootSlot(void);
+extern uint16_t GetNvmSlotMask(void);
+extern uint32_t GetNvmSlotNameHash(uint8_t slot);
+extern uint32_t GetNvmAnimationAddr(void);
+extern uint32_t GetNvmAnimationLength(void);
+extern bool IsNvmAnimationCompressed(void);
+extern uint32_t GetNvmAnimationRawLength(void);
+extern bool IsNvmAnimationIntact(void);
+
+#endif /* FLASH_HANDLER_H_ */
\ No newline at end of file
@@ -124,6 +124,9 @@ static struct tc_configuration _tcs[] = {
 
 static struct _timer_device *_tc3_dev = NULL;
 
+/* Compare channel 1 callback (events inside a timer period) */
+static void (*_tc_compare_cb)(void) = NULL;
+
 static int8_t         get_tc_index(const void *const hw);
 static uint8_t        tc_get_hardware_index(const void *const hw);
 static void           _tc_init_irq_param(const void *const hw, void *dev);
@@ -236,6 +239,14 @@ bool _timer_is_started(const struct _timer_device *const device)
 	return hri_tc_get_CTRLA_ENABLE_bit(device->hw);
 }
 
+/**
+ * \brief Register compare channel 1 callback
+ */
+void _tc_timer_register_compare_callback(void (*cb)(void))
+{
+	_tc_compare_cb = cb;
+}
+
 /**
  * \brief Retrieve timer helper functions
  */
@@ -273,6 +284,13 @@ static void tc_interrupt_handler(struct _timer_device *device)
 		hri_tc_clear_interrupt_OVF_bit(hw);
 		device->timer_cb.period_expired(device);
 	}
+
+	if (hri_tc_get_INTEN_MC1_bit(hw) && hri_tc_get_interrupt_MC1_bit(hw)) {
+		hri_tc_clear_interrupt_MC1_bit(hw);
+		if (_tc_compare_cb) {
+			_tc_compare_cb();
+		}
+	}
 }
 
 /**
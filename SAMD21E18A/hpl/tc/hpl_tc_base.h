@@ -68,6 +68,15 @@ struct _timer_hpl_interface *_tc_get_timer(void);
  */
 struct _pwm_hpl_interface *_tc_get_pwm(void);
 
+/**
+ * \brief Register compare channel 1 callback
+ *
+ * Invoked from the TC interrupt while the channel 1 match interrupt is enabled.
+ *
+ * \param[in] cb The callback, NULL to unregister
+ */
+void _tc_timer_register_compare_callback(void (*cb)(void));
+
 //@}
 /**@}*/
 
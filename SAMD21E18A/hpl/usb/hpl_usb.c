@@ -286,6 +286,56 @@ static inline void _usb_d_dev_wait_clk_rdy(const uint8_t clk_src)
 #define CONF_USB_EP9_I_CACHE 0
 #endif
 
+#ifndef CONF_USB_EP0_DBK
+/** Endpoint uses both banks for its direction in use (ping-pong). */
+#define CONF_USB_EP0_DBK 0
+#endif
+
+#ifndef CONF_USB_EP1_DBK
+/** Endpoint uses both banks for its direction in use (ping-pong). */
+#define CONF_USB_EP1_DBK 0
+#endif
+
+#ifndef CONF_USB_EP2_DBK
+/** Endpoint uses both banks for its direction in use (ping-pong). */
+#define CONF_USB_EP2_DBK 0
+#endif
+
+#ifndef CONF_USB_EP3_DBK
+/** Endpoint uses both banks for its direction in use (ping-pong). */
+#define CONF_USB_EP3_DBK 0
+#endif
+
+#ifndef CONF_USB_EP4_DBK
+/** Endpoint uses both banks for its direction in use (ping-pong). */
+#define CONF_USB_EP4_DBK 0
+#endif
+
+#ifndef CONF_USB_EP5_DBK
+/** Endpoint uses both banks for its direction in use (ping-pong). */
+#define CONF_USB_EP5_DBK 0
+#endif
+
+#ifndef CONF_USB_EP6_DBK
+/** Endpoint uses both banks for its direction in use (ping-pong). */
+#define CONF_USB_EP6_DBK 0
+#endif
+
+#ifndef CONF_USB_EP7_DBK
+/** Endpoint uses both banks for its direction in use (ping-pong). */
+#define CONF_USB_EP7_DBK 0
+#endif
+
+#ifndef CONF_USB_EP8_DBK
+/** Endpoint uses both banks for its direction in use (ping-pong). */
+#define CONF_USB_EP8_DBK 0
+#endif
+
+#ifndef CONF_USB_EP9_DBK
+/** Endpoint uses both banks for its direction in use (ping-pong). */
+#define CONF_USB_EP9_DBK 0
+#endif
+
 /** Endpoint cache buffer for OUT transactions (none-control) or SETUP/IN/OUT
  *  transactions (control). */
 #if CONF_USB_EP0_CACHE
@@ -451,12 +501,15 @@ struct _usb_ep_cfg_item {
 	uint16_t size;
 	/* Cache buffer size for IN transactions (none-control). */
 	uint16_t i_size;
+	/* Dual bank (ping-pong), cache of the direction in use holds both banks. */
+	bool dbk;
 };
 
 /** Build the endpoint configuration settings for one endpoint. */
 #define _USB_EP_CFG_ITEM(n)                                                                                            \
 	{                                                                                                                  \
 		_USB_EP_CACHE(n), _USB_EP_I_CACHE(n), CONF_USB_EP##n##_CACHE, CONF_USB_EP##n##_I_CACHE,                        \
+		    CONF_USB_EP##n##_DBK,                                                                                      \
 	}
 
 /** The configuration settings for all endpoint. */
@@ -540,6 +593,13 @@ struct _usb_d_dev_ep {
 		} bits;
 		uint8_t u8;
 	} flags;
+	/** Dual bank (ping-pong) state. */
+	struct {
+		/** Both banks are used by this endpoint, each with half of cache. */
+		uint8_t enabled : 1;
+		/** Next bank to read (OUT) or to load (IN). */
+		uint8_t next : 1;
+	} dbk;
 };
 
 /** Check if the endpoint is used. */
@@ -563,6 +623,9 @@ struct _usb_d_dev_ep {
 /** Interrupt flags for BANK0 transactions. */
 #define USB_D_BANK0_INT_FLAGS (USB_DEVICE_EPINTFLAG_TRCPT0 | USB_DEVICE_EPINTFLAG_TRFAIL0 | USB_DEVICE_EPINTFLAG_STALL0)
 
+/** Interrupt flags for dual bank transactions. */
+#define USB_D_DBK_INT_FLAGS (USB_DEVICE_EPINTFLAG_TRCPT0 | USB_DEVICE_EPINTFLAG_TRCPT1)
+
 /** Interrupt flags for SETUP/IN/OUT transactions. */
 #define USB_D_ALL_INT_FLAGS (0x7F)
 
@@ -628,6 +691,8 @@ static void _usb_d_dev_trans_stop(struct _usb_d_dev_ep *ept, bool dir, const int
 
 static void _usb_d_dev_in_next(struct _usb_d_dev_ep *ept, bool isr);
 static void _usb_d_dev_out_next(struct _usb_d_dev_ep *ept, bool isr);
+static void _usb_d_dev_in_next_dbk(struct _usb_d_dev_ep *ept);
+static void _usb_d_dev_out_next_dbk(struct _usb_d_dev_ep *ept);
 
 static inline void _usb_d_dev_trans_setup(struct _usb_d_dev_ep *ept);
 
@@ -1215,6 +1280,119 @@ _out_rx_exec:
 	_usbd_ep_set_out_rdy(epn, 0, true);
 }
 
+/**
+ * \brief Return cache half used by a bank of dual bank endpoint
+ * \param[in] ept Pointer to endpoint information.
+ * \param[in] bank_n Bank number.
+ */
+static inline uint8_t *_usb_d_dev_dbk_cache(struct _usb_d_dev_ep *ept, uint8_t bank_n)
+{
+	return &ept->cache[bank_n ? ept->size : 0];
+}
+
+/**
+ * \brief Synchronize next bank with hardware when both banks are idle
+ * \param[in] ept Pointer to endpoint information.
+ * \param[in] status Endpoint EPSTATUS value.
+ */
+static inline void _usb_d_dev_dbk_sync(struct _usb_d_dev_ep *ept, uint8_t status)
+{
+	if (!(status & (USB_DEVICE_EPSTATUS_BK0RDY | USB_DEVICE_EPSTATUS_BK1RDY))) {
+		ept->dbk.next = (status & USB_DEVICE_EPSTATUS_CURBK) ? 1 : 0;
+	}
+}
+
+/**
+ * \brief Load next IN packets to free banks of dual bank endpoint
+ * The transfer is done once all data is loaded, so the next transfer can be
+ * loaded to the other bank while the last packet is sent.
+ * \param[in] ept Pointer to endpoint information.
+ */
+static void _usb_d_dev_in_next_dbk(struct _usb_d_dev_ep *ept)
+{
+	Usb *    hw     = USB;
+	uint8_t  epn    = USB_EP_GET_N(ept->ep);
+	uint8_t  status = hri_usbendpoint_read_EPSTATUS_reg(hw, epn);
+	uint8_t  bank_n;
+	uint32_t trans_next;
+
+	/* Sent banks are free again, their completion needs no handling. */
+	_usbd_ep_int_ack(epn,
+	                 ((status & USB_DEVICE_EPSTATUS_BK0RDY) ? 0 : USB_DEVICE_EPINTFLAG_TRCPT0)
+	                     | ((status & USB_DEVICE_EPSTATUS_BK1RDY) ? 0 : USB_DEVICE_EPINTFLAG_TRCPT1));
+	_usb_d_dev_dbk_sync(ept, status);
+
+	while (ept->trans_count < ept->trans_size || ept->flags.bits.need_zlp) {
+		bank_n = ept->dbk.next;
+		if (status & (USB_DEVICE_EPSTATUS_BK0RDY << bank_n)) {
+			/* Wait for bank to be sent. */
+			hri_usbendpoint_set_EPINTEN_reg(hw, epn, USB_D_DBK_INT_FLAGS);
+			return;
+		}
+		trans_next = ept->trans_size - ept->trans_count;
+		if (trans_next > ept->size) {
+			trans_next = ept->size;
+		} else if (trans_next == 0) {
+			ept->flags.bits.need_zlp = 0;
+		}
+		memcpy(_usb_d_dev_dbk_cache(ept, bank_n), &ept->trans_buf[ept->trans_count], trans_next);
+		_usbd_ep_ack_io_cpt(epn, bank_n);
+		_usbd_ep_set_in_trans(epn, bank_n, trans_next, 0);
+		_usbd_ep_set_in_rdy(epn, bank_n, true);
+		ept->trans_count += trans_next;
+		ept->dbk.next ^= 1;
+		status = hri_usbendpoint_read_EPSTATUS_reg(hw, epn);
+	}
+	hri_usbendpoint_clear_EPINTEN_reg(hw, epn, USB_D_DBK_INT_FLAGS);
+	_usb_d_dev_trans_done(ept, USB_TRANS_DONE);
+}
+
+/**
+ * \brief Read received OUT packets from banks of dual bank endpoint
+ * Banks are re-armed as soon as read, so the host can send while the
+ * previous packet is processed.
+ * \param[in] ept Pointer to endpoint information.
+ */
+static void _usb_d_dev_out_next_dbk(struct _usb_d_dev_ep *ept)
+{
+	Usb *              hw     = USB;
+	uint8_t            epn    = USB_EP_GET_N(ept->ep);
+	UsbDeviceDescBank *bank   = prvt_inst.desc_table[epn].DeviceDescBank;
+	uint8_t            status = hri_usbendpoint_read_EPSTATUS_reg(hw, epn);
+	uint8_t            bank_n;
+	uint16_t           last_pkt;
+	uint32_t           buf_remain;
+
+	_usb_d_dev_dbk_sync(ept, status);
+
+	while (status & (USB_DEVICE_EPSTATUS_BK0RDY << ept->dbk.next)) {
+		bank_n     = ept->dbk.next;
+		last_pkt   = bank[bank_n].PCKSIZE.bit.BYTE_COUNT;
+		buf_remain = ept->trans_size - ept->trans_count;
+		if (last_pkt < buf_remain) {
+			buf_remain = last_pkt;
+		}
+		memcpy(&ept->trans_buf[ept->trans_count], _usb_d_dev_dbk_cache(ept, bank_n), buf_remain);
+		ept->trans_count += buf_remain;
+
+		/* Re-arm bank for background reception. */
+		_usbd_ep_ack_io_cpt(epn, bank_n);
+		_usbd_ep_set_out_trans(epn, bank_n, ept->size, 0);
+		_usbd_ep_set_out_rdy(epn, bank_n, true);
+		ept->dbk.next ^= 1;
+
+		/* Short packet or buffer full. */
+		if (last_pkt < ept->size || ept->trans_count >= ept->trans_size) {
+			hri_usbendpoint_clear_EPINTEN_reg(hw, epn, USB_D_DBK_INT_FLAGS);
+			_usb_d_dev_trans_done(ept, USB_TRANS_DONE);
+			return;
+		}
+		status = hri_usbendpoint_read_EPSTATUS_reg(hw, epn);
+	}
+	/* Wait for next packet. */
+	hri_usbendpoint_set_EPINTEN_reg(hw, epn, USB_D_DBK_INT_FLAGS);
+}
+
 /**
  * \brief Handles setup received interrupt
  * \param[in] ept Pointer to endpoint information.
@@ -1338,6 +1516,10 @@ static inline void _usb_d_dev_trans_in_isr(struct _usb_d_dev_ep *ept, const uint
 	 */
 	if (flags & USB_DEVICE_EPINTFLAG_STALL1) {
 		_usb_d_dev_handle_stall(ept, 1);
+	} else if (ept->dbk.enabled) {
+		if (flags & USB_D_DBK_INT_FLAGS) {
+			_usb_d_dev_in_next_dbk(ept);
+		}
 	} else if (flags & USB_DEVICE_EPINTFLAG_TRFAIL1) {
 		_usb_d_dev_handle_trfail(ept, 1);
 	} else if (flags & USB_DEVICE_EPINTFLAG_TRCPT1) {
@@ -1367,6 +1549,10 @@ static inline void _usb_d_dev_trans_out_isr(struct _usb_d_dev_ep *ept, const uin
 	 */
 	if (flags & USB_DEVICE_EPINTFLAG_STALL0) {
 		_usb_d_dev_handle_stall(ept, 0);
+	} else if (ept->dbk.enabled) {
+		if (flags & USB_D_DBK_INT_FLAGS) {
+			_usb_d_dev_out_next_dbk(ept);
+		}
 	} else if (flags & USB_DEVICE_EPINTFLAG_TRFAIL0) {
 		_usb_d_dev_handle_trfail(ept, 0);
 	} else if (flags & USB_DEVICE_EPINTFLAG_TRCPT0) {
@@ -1649,12 +1835,23 @@ int32_t _usb_d_dev_ep_init(const uint8_t ep, const uint8_t attr, const uint16_t
 	if ((dir ? pcfg->i_cache : pcfg->cache) && ((dir ? pcfg->i_size : pcfg->size) < max_pkt_siz)) {
 		return -USB_ERR_FUNC;
 	}
+	if (pcfg->dbk && ep_type != USB_EP_XTYPE_CTRL) {
+		/* Dual bank takes the other direction's bank, and needs cache for both banks. */
+		if (_usb_d_dev_ept(epn, !dir)->ep != 0xFF) {
+			return -USB_ERR_REDO;
+		}
+		if (!(dir ? pcfg->i_cache : pcfg->cache) || ((dir ? pcfg->i_size : pcfg->size) < max_pkt_siz * 2)) {
+			return -USB_ERR_FUNC;
+		}
+	}
 
 	/* Initialize EP n settings */
-	ept->cache    = (uint8_t *)(dir ? pcfg->i_cache : pcfg->cache);
-	ept->size     = max_pkt_siz;
-	ept->flags.u8 = (ep_type + 1);
-	ept->ep       = ep;
+	ept->cache       = (uint8_t *)(dir ? pcfg->i_cache : pcfg->cache);
+	ept->size        = max_pkt_siz;
+	ept->flags.u8    = (ep_type + 1);
+	ept->ep          = ep;
+	ept->dbk.enabled = pcfg->dbk && ep_type != USB_EP_XTYPE_CTRL;
+	ept->dbk.next    = 0;
 
 	return USB_OK;
 }
@@ -1674,8 +1871,8 @@ void _usb_d_dev_ep_deinit(uint8_t ep)
 	_usb_d_dev_trans_stop(ept, dir, USB_TRANS_RESET);
 
 	/* Disable the endpoint. */
-	if (_usb_d_dev_ep_is_ctrl(ept)) {
-		hw->DEVICE.DeviceEndpoint[ep].EPCFG.reg = 0;
+	if (_usb_d_dev_ep_is_ctrl(ept) || ept->dbk.enabled) {
+		hw->DEVICE.DeviceEndpoint[USB_EP_GET_N(ep)].EPCFG.reg = 0;
 	} else if (USB_EP_GET_DIR(ep)) {
 		hw->DEVICE.DeviceEndpoint[USB_EP_GET_N(ep)].EPCFG.reg &= ~USB_DEVICE_EPCFG_EPTYPE1_Msk;
 	} else {
@@ -1693,6 +1890,7 @@ int32_t _usb_d_dev_ep_enable(const uint8_t ep)
 	struct _usb_d_dev_ep *ept   = _usb_d_dev_ept(epn, dir);
 	uint8_t               epcfg = hri_usbendpoint_read_EPCFG_reg(hw, epn);
 	UsbDeviceDescBank *   bank;
+	uint8_t               bank_n;
 
 	if (epn > CONF_USB_D_MAX_EP_N || !_usb_d_dev_ep_is_used(ept)) {
 		return -USB_ERR_PARAM;
@@ -1718,6 +1916,34 @@ int32_t _usb_d_dev_ep_enable(const uint8_t ep)
 		/* Enable SETUP reception for control endpoint. */
 		_usb_d_dev_trans_setup(ept);
 
+	} else if (ept->dbk.enabled) {
+		if (epcfg & (USB_DEVICE_EPCFG_EPTYPE1_Msk | USB_DEVICE_EPCFG_EPTYPE0_Msk)) {
+			return -USB_ERR_REDO;
+		}
+		/* Unused direction is set to dual bank type. */
+		if (dir) {
+			epcfg = USB_DEVICE_EPCFG_EPTYPE1(ept->flags.bits.eptype) | USB_DEVICE_EPCFG_EPTYPE0(USB_D_EPTYPE_DUAL);
+		} else {
+			epcfg = USB_DEVICE_EPCFG_EPTYPE0(ept->flags.bits.eptype) | USB_DEVICE_EPCFG_EPTYPE1(USB_D_EPTYPE_DUAL);
+		}
+		hri_usbendpoint_write_EPCFG_reg(hw, epn, epcfg);
+
+		for (bank_n = 0; bank_n < 2; bank_n++) {
+			bank[bank_n].PCKSIZE.reg = USB_DEVICE_PCKSIZE_SIZE(_usbd_ep_pcksize_size(ept->size));
+			_usbd_ep_set_buf(epn, bank_n, (uint32_t)_usb_d_dev_dbk_cache(ept, bank_n));
+			_usbd_ep_clear_bank_status(epn, bank_n);
+			if (dir) {
+				/* By default, IN endpoint will NAK all token. */
+				_usbd_ep_set_in_rdy(epn, bank_n, false);
+			} else {
+				/* OUT banks receive in background from now on. */
+				_usbd_ep_set_out_trans(epn, bank_n, ept->size, 0);
+				_usbd_ep_set_out_rdy(epn, bank_n, true);
+			}
+		}
+		hri_usbendpoint_clear_EPSTATUS_reg(hw, epn, USB_DEVICE_EPSTATUS_CURBK);
+		ept->dbk.next = 0;
+
 	} else if (dir) {
 		if (epcfg & USB_DEVICE_EPCFG_EPTYPE1_Msk) {
 			return -USB_ERR_REDO;
@@ -1873,7 +2099,16 @@ static void _usb_d_dev_trans_stop(struct _usb_d_dev_ep *ept, bool dir, const int
 		return;
 	}
 	/* Stop transfer */
-	if (dir) {
+	if (ept->dbk.enabled) {
+		/* Drop loaded IN banks, OUT banks keep receiving for next transfer. */
+		if (dir) {
+			_usbd_ep_set_in_rdy(epn, 0, false);
+			_usbd_ep_set_in_rdy(epn, 1, false);
+		}
+		_usbd_ep_int_dis(epn, USB_D_DBK_INT_FLAGS);
+		_usb_d_dev_trans_done(ept, code);
+		return;
+	} else if (dir) {
 		/* NAK IN */
 		_usbd_ep_set_in_rdy(epn, 1, false);
 	} else {
@@ -1969,7 +2204,14 @@ int32_t _usb_d_dev_ep_trans(const struct usb_d_transfer *trans)
 	ept->flags.bits.use_cache = use_cache;
 	ept->flags.bits.need_zlp  = (trans->zlp && (!size_n_aligned));
 
-	if (dir) {
+	if (ept->dbk.enabled) {
+		/* Data is always staged through bank caches. */
+		if (dir) {
+			_usb_d_dev_in_next_dbk(ept);
+		} else {
+			_usb_d_dev_out_next_dbk(ept);
+		}
+	} else if (dir) {
 		_usb_d_dev_in_next(ept, false);
 	} else {
 		_usb_d_dev_out_next(ept, false);
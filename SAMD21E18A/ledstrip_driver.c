@@ -20,15 +20,58 @@
 #include "..\..\GlowDecompiler\public_api.h"
 #include "driver_init.h"
 #include <string.h>
+#include <hpl_dma.h>
+#include <hpl_gclk_base.h>
+#include <hpl_pm_base.h>
+#include <utils_repeat_macro.h>
 #include "ledstrip_driver.h"
+#include "timer_handler.h"
 
 // Uncomment LED sequence to match IC:
 #define LED_SEQUENCE_RBG  // adafruit apa102c
 //#define LED_SEQUENCE_BGR    // shiji-led apa102c
 //#define LED_SEQUENCE_RGB
 
+// Uncomment LED output backend:
+#define LED_OUTPUT_BITBANG    // gpio bit-bang of the 3 elektra ledstrips (blocking).
+//#define LED_OUTPUT_BITBANG_IOBUS    // single-cycle iobus bit-bang of the 3 elektra ledstrips (blocking, estimated ~25x faster).
+//#define LED_OUTPUT_PARALLEL    // gpio bit-bang of the 3 elektra ledstrips clocked together (blocking, ~3x faster).
+//#define LED_OUTPUT_SPI_DMA    // sercom spi master fed by dmac (non-blocking), drives a single chain on the ext header.
+
 #define NUL 0
 
+#define NB_HW_LEDSTRIPS 3
+#define MAX_HW_LEDSTRIP_COUNT (INNER_LED_COUNT > OUTER_LED_COUNT \
+    ? (INNER_LED_COUNT > EDGE_LED_COUNT ? INNER_LED_COUNT : EDGE_LED_COUNT) \
+    : (OUTER_LED_COUNT > EDGE_LED_COUNT ? OUTER_LED_COUNT : EDGE_LED_COUNT))
+
+// Estimated cost of one 32-bit frame @ 48MHz, from instruction counts (not measured, the cycles of the last output are
+// sent in status page 0, bytes 3-6):
+//  LED_OUTPUT_BITBANG:       ~6600 cycles (3.6ms / 26 frames), 2 loop passes per bit each with a clock pin read-back in a critical section.
+//  LED_OUTPUT_BITBANG_IOBUS: ~230 cycles (~7 cycles per unrolled bit), 26 frames in ~0.13ms.
+
+#ifdef LED_OUTPUT_PARALLEL
+// All data pins and the shared clock pin must be on port A:
+#define LED_CLK_MASK (1UL << GPIO_PIN(LED_CLK_PIN))
+#define LED_DATA_MASK ((1UL << GPIO_PIN(INNER_LED_DATA_PIN)) | (1UL << GPIO_PIN(OUTER_LED_DATA_PIN)) | (1UL << GPIO_PIN(EDGE_LED_DATA_PIN)))
+#endif
+
+#ifdef LED_OUTPUT_SPI_DMA
+// Spi output configuration (dmac channel trigger source in hpl_dmac_config.h must match the sercom tx trigger):
+#define LED_SPI_SERCOM SERCOM2
+#define LED_SPI_GCLK_ID SERCOM2_GCLK_ID_CORE
+#define LED_SPI_GCLK_SRC GCLK_CLKCTRL_GEN_GCLK2_Val    // dfll48m, independent of cpu clock scaling.
+#define LED_SPI_GCLK_FREQUENCY 48000000
+#define LED_SPI_BAUD_HZ 8000000    // apa102 clock rate, max 24MHz (baud = gclk / 2).
+#define LED_SPI_DOPO 1    // data out on pad2, sck on pad3.
+#define LED_SPI_MOSI_PIN EXT_LED_DATA_PIN
+#define LED_SPI_MOSI_PINMUX PINMUX_PA14C_SERCOM2_PAD2
+#define LED_SPI_SCK_PIN GPIO(GPIO_PORTA, 11)
+#define LED_SPI_SCK_PINMUX PINMUX_PA11D_SERCOM2_PAD3
+#define LED_SPI_DMA_CHANNEL 0
+#define LED_SPI_WIRE_WORDS (ELEKTRA_LED_COUNT + 2)    // start frame + data frames + stop frame.
+#endif
+
 union LedDataFrame
 {
     struct DataFrame
@@ -54,15 +97,147 @@ union LedDataFrame
     uint32_t value;
 };
 
+struct HwLedstrip
+{
+    uint8_t dataPin;
+    uint8_t firstLedIdx;    // index of first led in the abstract ledstrip.
+    uint8_t numLeds;
+};
+
 static union LedDataFrame _ledDataFrame = { .bitmap.unused = 7 };
 static uint32_t _ledStartFrame = 0x00000000;
 static uint32_t _ledStopFrame  = 0xFFFFFFFF;
 
+// Elektra hardware ledstrips, all sharing LED_CLK_PIN:
+static const struct HwLedstrip _hwLedstrips[NB_HW_LEDSTRIPS] =
+{
+    { INNER_LED_DATA_PIN, 0, INNER_LED_COUNT },
+    { OUTER_LED_DATA_PIN, INNER_LED_COUNT, OUTER_LED_COUNT },
+    { EDGE_LED_DATA_PIN, INNER_LED_COUNT + OUTER_LED_COUNT, EDGE_LED_COUNT },
+};
+
+#if ELEKTRA_LED_COUNT > 32
+#error "Per-led dirty bits require ELEKTRA_LED_COUNT <= 32."
+#endif
+
+#define LED_FRAME_RING_SZ 4    // power of 2, frames the decoder may render ahead of the tick.
+
+// Frame cache of encoded apa102 data frames:
+struct LedFrameBuffer
+{
+    uint32_t ledFrames[ELEKTRA_LED_COUNT];    // zero-initialized, never equal to an encoded frame (unused bits are set).
+    uint32_t dirtyLeds;    // bit per led differing from the last output front frame (front frame only).
+    uint8_t dirtyStrips;    // bit per hardware ledstrip holding a dirty led (front frame only).
+    uint8_t numLeds;
+    bool isRepeat;    // decoder rendered no change, leds keep the previous frame (ring frames only).
+    uint32_t tickPeriodNum;    // tick period requested while rendering, applied when the frame reaches the tick
+    uint32_t tickPeriodDen;    // (ring frames only, 0: unchanged).
+};
+
+// Render ring: decoder renders frames ahead into the ring while the front frame is on the leds/wire, the oldest
+// ring frame becomes the front frame on the tick:
+static struct LedFrameBuffer _ledFrontFrame;
+static struct LedFrameBuffer _ledFrameRing[LED_FRAME_RING_SZ];
+static uint8_t _u8LedRingHead;    // slot being rendered.
+static uint8_t _u8LedRingCount;    // rendered frames not yet presented (lead over the tick).
+static bool _isLedRingSlotRendered;    // slot at head was written since last PushLedFrame().
+static bool _isFramePipelineEnabled;    // when disabled, frames are presented as soon as they are rendered.
+
+static uint32_t _u32LedOutputCycles;    // cpu cycles spent in last PresentLedFrame().
+
+// Forces retransmission of all leds on next presented frame, also when it repeats the front frame (e.g. after led
+// power-up, or when the encoding of unchanged pixels changes):
+void InvalidateLedFrameCache()
+{
+    _ledFrontFrame.dirtyLeds = ~0UL;
+    _ledFrontFrame.dirtyStrips = (1 << NB_HW_LEDSTRIPS) - 1;
+}
+
+#ifdef LED_OUTPUT_SPI_DMA
+static uint32_t _ledSpiWireBuffer[LED_SPI_WIRE_WORDS];    // frames stored msb-first in spi byte order.
+static volatile bool _isLedDmaBusy;    // volatile critical.
+#endif
+
 void LedPowerInit()
 {
     gpio_set_pin_level(LED_PWR_EN, 1);
+    InvalidateLedFrameCache();    // powered-up leds do not hold the front frame.
+}
+
+#ifdef LED_OUTPUT_SPI_DMA
+
+static void LedDmaTransferDone(struct _dma_resource *resource)
+{
+    (void)resource;
+    _isLedDmaBusy = false;
+}
+
+static void LedSpiInit(void)
+{
+    struct _dma_resource *dmaResource;
+
+    // Sercom clocks:
+    _pm_enable_bus_clock(PM_BUS_APBC, LED_SPI_SERCOM);
+    _gclk_enable_channel(LED_SPI_GCLK_ID, LED_SPI_GCLK_SRC);
+
+    // Spi master, mode 0, msb first, transmit only:
+    hri_sercomspi_set_CTRLA_SWRST_bit(LED_SPI_SERCOM);
+    hri_sercomspi_write_CTRLA_reg(LED_SPI_SERCOM, SERCOM_SPI_CTRLA_MODE(3) | SERCOM_SPI_CTRLA_DOPO(LED_SPI_DOPO));
+    hri_sercomspi_write_CTRLB_reg(LED_SPI_SERCOM, SERCOM_SPI_CTRLB_CHSIZE(0));
+    hri_sercomspi_write_BAUD_reg(LED_SPI_SERCOM, LED_SPI_GCLK_FREQUENCY / (2 * LED_SPI_BAUD_HZ) - 1);
+    hri_sercomspi_set_CTRLA_ENABLE_bit(LED_SPI_SERCOM);
+
+    // Route sercom pads to pins:
+    gpio_set_pin_function(LED_SPI_MOSI_PIN, LED_SPI_MOSI_PINMUX);
+    gpio_set_pin_direction(LED_SPI_SCK_PIN, GPIO_DIRECTION_OUT);
+    gpio_set_pin_function(LED_SPI_SCK_PIN, LED_SPI_SCK_PINMUX);
+
+    // Dma channel writes one wire buffer byte to the spi data register per tx trigger:
+    _dma_get_channel_resource(&dmaResource, LED_SPI_DMA_CHANNEL);
+    dmaResource->dma_cb.transfer_done = LedDmaTransferDone;
+    dmaResource->dma_cb.error = LedDmaTransferDone;
+    _dma_set_irq_state(LED_SPI_DMA_CHANNEL, DMA_TRANSFER_COMPLETE_CB, true);
+    _dma_set_irq_state(LED_SPI_DMA_CHANNEL, DMA_TRANSFER_ERROR_CB, true);
+    _dma_set_destination_address(LED_SPI_DMA_CHANNEL, (void *)&((Sercom *)LED_SPI_SERCOM)->SPI.DATA.reg);
+
+    // Start and stop frames never change:
+    _ledSpiWireBuffer[0] = __REV(_ledStartFrame);
+    _ledSpiWireBuffer[LED_SPI_WIRE_WORDS - 1] = __REV(_ledStopFrame);
+}
+
+static void LedSpiTransmit(uint16_t numBytes)
+{
+    _isLedDmaBusy = true;
+    _dma_set_source_address(LED_SPI_DMA_CHANNEL, _ledSpiWireBuffer);
+    _dma_set_data_amount(LED_SPI_DMA_CHANNEL, numBytes);    // must follow source address (sets end address).
+    _dma_enable_transaction(LED_SPI_DMA_CHANNEL, false);
+}
+
+#endif
+
+void LedOutputInit()
+{
+#ifdef LED_OUTPUT_SPI_DMA
+    LedSpiInit();
+#endif
+}
+
+bool IsLedOutputBusy()
+{
+#ifdef LED_OUTPUT_SPI_DMA
+    return _isLedDmaBusy;
+#else
+    return false;    // bit-bang output completes before returning.
+#endif
 }
 
+uint32_t GetLedOutputCycles()
+{
+    return _u32LedOutputCycles;
+}
+
+#ifdef LED_OUTPUT_BITBANG
+
 static void ProgramLedFrame(uint8_t dataPin, uint32_t ledFrame)
 {
     bool next_clk_level;
@@ -80,42 +255,367 @@ static void ProgramLedFrame(uint8_t dataPin, uint32_t ledFrame)
     }
 }
 
-// Duration of 3 led strips programming: 3.6ms @ 48MHz cpu clock.
-// TODO: Can be faster if all 3 ledstrips are programmed in parallel.
-void ProgramLedstrip(struct LedstripBuffer *ledstrip)
+#endif
+
+#ifdef LED_OUTPUT_BITBANG_IOBUS
+
+// Single bit: clock falling edge and data level, then clock rising edge. Clock level is implied by the
+// position in the unrolled sequence (never read back) and next bit test runs while the clock is high.
+// One nop pads the clock low time to 3 cycles (63ns) and the data setup to 2 cycles (42ns) @ 48MHz; consecutive
+// iobus writes alone give 21-42ns, below the apa102/sk9822 timing.
+#define PROGRAM_LED_BIT(ledFrame, n)                                      \
+    if ((ledFrame) & (1UL << (31 - (n))))                                 \
+    {                                                                     \
+        port->OUTCLR.reg = clkMask;                                       \
+        port->OUTSET.reg = dataMask;                                      \
+    }                                                                     \
+    else                                                                  \
+    {                                                                     \
+        port->OUTCLR.reg = clkMask;                                       \
+        port->OUTCLR.reg = dataMask;                                      \
+    }                                                                     \
+    __NOP();                                                              \
+    port->OUTSET.reg = clkMask;
+
+static void ProgramLedFrame(uint8_t dataPin, uint32_t ledFrame)
 {
-    ledstrip->isDirty = false;
+    PortGroup *const port = &PORT_IOBUS->Group[GPIO_PORT(LED_CLK_PIN)];
+    const uint32_t clkMask = 1UL << GPIO_PIN(LED_CLK_PIN);
+    const uint32_t dataMask = 1UL << GPIO_PIN(dataPin);
 
-    // program single led per loop:
-    for (int ledIdx = 0; ledIdx < ledstrip->numLeds; ledIdx++)
+    REPEAT_MACRO(PROGRAM_LED_BIT, ledFrame, 32)
+}
+
+#endif
+
+#ifdef LED_OUTPUT_PARALLEL
+
+// Bit-slice one frame of each hardware ledstrip into port masks and clock all 3 strips together:
+static void ProgramParallelLedFrame(const uint32_t *stripFrames)
+{
+    for (int8_t bitIdx = 31; bitIdx >= 0; bitIdx--)
     {
-        _ledDataFrame.bitmap.red = ledstrip->leds[ledIdx].red;
-        _ledDataFrame.bitmap.green = ledstrip->leds[ledIdx].green;
-        _ledDataFrame.bitmap.blue = ledstrip->leds[ledIdx].blue;
-        _ledDataFrame.bitmap.bright = ledstrip->leds[ledIdx].bright;
+        uint32_t dataSetMask = (((stripFrames[0] >> bitIdx) & 1) << GPIO_PIN(INNER_LED_DATA_PIN))
+                             | (((stripFrames[1] >> bitIdx) & 1) << GPIO_PIN(OUTER_LED_DATA_PIN))
+                             | (((stripFrames[2] >> bitIdx) & 1) << GPIO_PIN(EDGE_LED_DATA_PIN));
 
-        // Elektra-specific led programming (translate single abstract ledstrip to the 3 hardware ledstrips):
-        if (ledIdx < INNER_LED_COUNT)
+        // clock falling edge and data lines low in one write, then data lines high, then clock rising edge:
+        hri_port_clear_OUT_reg(PORT_IOBUS, GPIO_PORTA, LED_CLK_MASK | (LED_DATA_MASK & ~dataSetMask));
+        hri_port_set_OUT_reg(PORT_IOBUS, GPIO_PORTA, dataSetMask);
+        hri_port_set_OUT_reg(PORT_IOBUS, GPIO_PORTA, LED_CLK_MASK);
+    }
+}
+
+#endif
+
+static uint32_t EncodeLedFrame(struct LedstripBuffer *ledstrip, int ledIdx)
+{
+    _ledDataFrame.bitmap.red = ledstrip->leds[ledIdx].red;
+    _ledDataFrame.bitmap.green = ledstrip->leds[ledIdx].green;
+    _ledDataFrame.bitmap.blue = ledstrip->leds[ledIdx].blue;
+    _ledDataFrame.bitmap.bright = ledstrip->leds[ledIdx].bright;
+    return _ledDataFrame.value;
+}
+
+// Encode the abstract ledstrip into the ring slot being rendered:
+static void RenderRingFrame(struct LedstripBuffer *ledstrip)
+{
+    struct LedFrameBuffer *ptrFrame = &_ledFrameRing[_u8LedRingHead];
+
+    ptrFrame->numLeds = ledstrip->numLeds < ELEKTRA_LED_COUNT ? ledstrip->numLeds : ELEKTRA_LED_COUNT;
+    ptrFrame->isRepeat = false;
+
+    for (int ledIdx = 0; ledIdx < ptrFrame->numLeds; ledIdx++)
+    {
+        ptrFrame->ledFrames[ledIdx] = EncodeLedFrame(ledstrip, ledIdx);
+    }
+    _isLedRingSlotRendered = true;
+}
+
+// Copy ring frame into the front frame and mark leds and hardware ledstrips that changed as dirty
+// (done on present or drop, dirty bits of dropped frames accumulate until the front frame is output):
+static void UpdateFrontFrame(const struct LedFrameBuffer *ptrFrame)
+{
+    struct LedFrameBuffer *ptrFront = &_ledFrontFrame;
+
+    ptrFront->numLeds = ptrFrame->numLeds;
+
+    for (uint8_t stripIdx = 0; stripIdx < NB_HW_LEDSTRIPS; stripIdx++)
+    {
+        const struct HwLedstrip *hwLedstrip = &_hwLedstrips[stripIdx];
+
+        for (int ledOffset = 0; ledOffset < hwLedstrip->numLeds; ledOffset++)
         {
-            if (ledIdx == 0) ProgramLedFrame(INNER_LED_DATA_PIN, _ledStartFrame);   // program start frame.
-            ProgramLedFrame(INNER_LED_DATA_PIN, _ledDataFrame.value);   // program data frame.
-            if (ledIdx == INNER_LED_COUNT - 1) ProgramLedFrame(INNER_LED_DATA_PIN, _ledStopFrame); // program stop frame.
+            int ledIdx = hwLedstrip->firstLedIdx + ledOffset;
+            if (ledIdx >= ptrFront->numLeds) break;
+
+            if (ptrFrame->ledFrames[ledIdx] != ptrFront->ledFrames[ledIdx])
+            {
+                ptrFront->ledFrames[ledIdx] = ptrFrame->ledFrames[ledIdx];
+                ptrFront->dirtyLeds |= 1UL << ledIdx;
+                ptrFront->dirtyStrips |= 1 << stripIdx;
+            }
         }
-        else if (ledIdx < INNER_LED_COUNT + OUTER_LED_COUNT)
+    }
+}
+
+#ifdef LED_OUTPUT_SPI_DMA
+
+// Duration of 20 leds at 8MHz spi clock: 88us of dma transfer, cpu only re-encodes changed leds into the wire buffer.
+static void OutputLedFrame(const struct LedFrameBuffer *ptrFrame)
+{
+    // Single chain, retransmitted whole when any led changed:
+    if (ptrFrame->dirtyStrips == 0) return;
+
+    while (_isLedDmaBusy) continue;    // previous frame is still being transmitted from the wire buffer.
+
+    // Encode changed data frames in spi byte order (msb of red/blue/green byte sequence first):
+    for (int ledIdx = 0; ledIdx < ptrFrame->numLeds; ledIdx++)
+    {
+        if (ptrFrame->dirtyLeds & (1UL << ledIdx)) _ledSpiWireBuffer[ledIdx + 1] = __REV(ptrFrame->ledFrames[ledIdx]);
+    }
+    _ledSpiWireBuffer[ptrFrame->numLeds + 1] = __REV(_ledStopFrame);
+
+    LedSpiTransmit((ptrFrame->numLeds + 2) * sizeof(uint32_t));
+}
+
+#elif defined(LED_OUTPUT_PARALLEL)
+
+// Duration of 3 led strips programming in parallel: (8 + 2) frames instead of (20 + 6) frames of the serial bit-bang.
+// Clean strips keep their data line high (stop frames) so they see no start frame and keep their leds.
+static void OutputLedFrame(const struct LedFrameBuffer *ptrFrame)
+{
+    uint32_t stripFrames[NB_HW_LEDSTRIPS];
+    uint8_t stripIdx;
+
+    if (ptrFrame->dirtyStrips == 0) return;
+
+    // program start frame on dirty strips:
+    for (stripIdx = 0; stripIdx < NB_HW_LEDSTRIPS; stripIdx++)
+    {
+        stripFrames[stripIdx] = (ptrFrame->dirtyStrips & (1 << stripIdx)) ? _ledStartFrame : _ledStopFrame;
+    }
+    ProgramParallelLedFrame(stripFrames);
+
+    // program data frames, shorter and clean strips are padded with stop frames:
+    for (int frameIdx = 0; frameIdx <= MAX_HW_LEDSTRIP_COUNT; frameIdx++)
+    {
+        for (stripIdx = 0; stripIdx < NB_HW_LEDSTRIPS; stripIdx++)
         {
-            if (ledIdx == INNER_LED_COUNT) ProgramLedFrame(OUTER_LED_DATA_PIN, _ledStartFrame);   // program start frame.
-            ProgramLedFrame(OUTER_LED_DATA_PIN, _ledDataFrame.value);   // program data frame.
-            if (ledIdx == INNER_LED_COUNT + OUTER_LED_COUNT - 1) ProgramLedFrame(OUTER_LED_DATA_PIN, _ledStopFrame); // program stop frame.
+            int ledIdx = _hwLedstrips[stripIdx].firstLedIdx + frameIdx;
+            if ((ptrFrame->dirtyStrips & (1 << stripIdx)) && frameIdx < _hwLedstrips[stripIdx].numLeds && ledIdx < ptrFrame->numLeds)
+            {
+                stripFrames[stripIdx] = ptrFrame->ledFrames[ledIdx];
+            }
+            else
+            {
+                stripFrames[stripIdx] = _ledStopFrame;
+            }
         }
-        else if (ledIdx < INNER_LED_COUNT + OUTER_LED_COUNT + EDGE_LED_COUNT)
+        ProgramParallelLedFrame(stripFrames);
+    }
+}
+
+#elif defined(LED_OUTPUT_BITBANG) || defined(LED_OUTPUT_BITBANG_IOBUS)
+
+// Duration of 3 led strips programming: 3.6ms @ 48MHz cpu clock (only dirty strips are programmed).
+// LED_OUTPUT_PARALLEL programs the 3 ledstrips at once.
+static void OutputLedFrame(const struct LedFrameBuffer *ptrFrame)
+{
+    // Elektra-specific led programming (translate single abstract ledstrip to the 3 hardware ledstrips):
+    for (uint8_t stripIdx = 0; stripIdx < NB_HW_LEDSTRIPS; stripIdx++)
+    {
+        const struct HwLedstrip *hwLedstrip = &_hwLedstrips[stripIdx];
+
+        if (!(ptrFrame->dirtyStrips & (1 << stripIdx))) continue;
+
+        // program single led per loop:
+        for (int ledOffset = 0; ledOffset < hwLedstrip->numLeds; ledOffset++)
         {
-            if (ledIdx == INNER_LED_COUNT + OUTER_LED_COUNT) ProgramLedFrame(EDGE_LED_DATA_PIN, _ledStartFrame);   // program start frame.
-            ProgramLedFrame(EDGE_LED_DATA_PIN, _ledDataFrame.value);   // program data frame.
-            if (ledIdx == INNER_LED_COUNT + OUTER_LED_COUNT + EDGE_LED_COUNT - 1) ProgramLedFrame(EDGE_LED_DATA_PIN, _ledStopFrame); // program stop frame.
+            int ledIdx = hwLedstrip->firstLedIdx + ledOffset;
+            if (ledIdx >= ptrFrame->numLeds) break;
+
+            if (ledOffset == 0) ProgramLedFrame(hwLedstrip->dataPin, _ledStartFrame);   // program start frame.
+            ProgramLedFrame(hwLedstrip->dataPin, ptrFrame->ledFrames[ledIdx]);   // program data frame.
+            if (ledOffset == hwLedstrip->numLeds - 1) ProgramLedFrame(hwLedstrip->dataPin, _ledStopFrame); // program stop frame.
         }
     }
 }
 
+#endif
+
+
+// Tick period changes travel with the frame they were requested for (the decoder renders ahead of the tick):
+void SetLedFrameTickPeriod(uint32_t periodNum, uint32_t periodDen)
+{
+    _ledFrameRing[_u8LedRingHead].tickPeriodNum = periodNum;
+    _ledFrameRing[_u8LedRingHead].tickPeriodDen = periodDen;
+}
+
+static void ApplyFrameTickPeriod(const struct LedFrameBuffer *ptrFrame)
+{
+    if (ptrFrame->tickPeriodDen) ApplyTickPeriod(ptrFrame->tickPeriodNum, ptrFrame->tickPeriodDen);
+}
+
+// Output oldest ring frame. Called on the tick boundary so that light output happens at a fixed phase from the tick
+// regardless of how long the decoder took to render. Returns false if no frame was rendered ahead (underrun).
+bool PresentLedFrame()
+{
+    struct LedFrameBuffer *ptrFrame;
+    uint32_t startCycles;
+
+    if (!_u8LedRingCount) return false;
+
+    startCycles = GetCycleCount();
+
+    ptrFrame = &_ledFrameRing[(_u8LedRingHead - _u8LedRingCount) & (LED_FRAME_RING_SZ - 1)];
+    _u8LedRingCount--;
+    ApplyFrameTickPeriod(ptrFrame);
+
+    // A repeat still outputs changes of frames dropped before it:
+    if (!ptrFrame->isRepeat) UpdateFrontFrame(ptrFrame);
+    if (_ledFrontFrame.dirtyStrips)
+    {
+        OutputLedFrame(&_ledFrontFrame);
+        _ledFrontFrame.dirtyLeds = 0;
+        _ledFrontFrame.dirtyStrips = 0;
+    }
+
+    _u32LedOutputCycles = GetCyclesElapsed(startCycles);
+    return true;
+}
+
+// Drop oldest ring frame without output (frame of a skipped tick), its changes are output with the next presented frame:
+void DropLedFrame()
+{
+    if (!_u8LedRingCount) return;
+
+    struct LedFrameBuffer *ptrFrame = &_ledFrameRing[(_u8LedRingHead - _u8LedRingCount) & (LED_FRAME_RING_SZ - 1)];
+    _u8LedRingCount--;
+    ApplyFrameTickPeriod(ptrFrame);
+    if (!ptrFrame->isRepeat) UpdateFrontFrame(ptrFrame);
+}
+
+// End frame of one decoder step: queue the rendered slot (or a repeat of the previous frame when the decoder rendered
+// nothing) and move on to the next slot. The caller keeps the ring from overflowing (IsLedFrameRingFull()).
+void PushLedFrame()
+{
+    if (!_isLedRingSlotRendered) _ledFrameRing[_u8LedRingHead].isRepeat = true;
+    _isLedRingSlotRendered = false;
+
+    if (_u8LedRingCount == LED_FRAME_RING_SZ) _u8LedRingCount--;    // oldest frame is overwritten.
+    _u8LedRingHead = (_u8LedRingHead + 1) & (LED_FRAME_RING_SZ - 1);
+    _u8LedRingCount++;
+    _ledFrameRing[_u8LedRingHead].tickPeriodDen = 0;
+}
+
+// Returns number of frames rendered ahead of the tick:
+uint8_t GetLedFrameLead()
+{
+    return _u8LedRingCount;
+}
+
+bool IsLedFrameRingFull()
+{
+    return _u8LedRingCount == LED_FRAME_RING_SZ;
+}
+
+uint8_t GetLedFrameRingSize()
+{
+    return LED_FRAME_RING_SZ;
+}
+
+// Enabled while an animation runs (frames presented on ticks), disabled otherwise (frames presented immediately).
+void SetLedFramePipeline(bool isEnabled)
+{
+    _isFramePipelineEnabled = isEnabled;
+    if (isEnabled) return;
+
+    // Flush frame due next, frames rendered further ahead are dropped (tick periods they requested still apply):
+    if (_isLedRingSlotRendered || _ledFrameRing[_u8LedRingHead].tickPeriodDen) PushLedFrame();
+    PresentLedFrame();
+    while (_u8LedRingCount)
+    {
+        ApplyFrameTickPeriod(&_ledFrameRing[(_u8LedRingHead - _u8LedRingCount) & (LED_FRAME_RING_SZ - 1)]);
+        _u8LedRingCount--;
+    }
+}
+
+bool IsLedFramePipelineEnabled()
+{
+    return _isFramePipelineEnabled;
+}
+
+void ProgramLedstrip(struct LedstripBuffer *ledstrip)
+{
+    ledstrip->isDirty = false;
+
+    RenderRingFrame(ledstrip);
+
+    if (!_isFramePipelineEnabled)
+    {
+        PushLedFrame();
+        PresentLedFrame();
+    }
+}
+
+#pragma region Live frames
+
+// Live frames are written by the host straight into the ring slot at head (no abstract ledstrip, no decoder).
+// Leds not written keep the data of the front frame:
+void BeginLedFrame()
+{
+    struct LedFrameBuffer *ptrFrame = &_ledFrameRing[_u8LedRingHead];
+
+    _u8LedRingCount = 0;    // a rendered frame not yet presented is superseded.
+    memcpy(ptrFrame->ledFrames, _ledFrontFrame.ledFrames, sizeof(ptrFrame->ledFrames));
+    ptrFrame->numLeds = ELEKTRA_LED_COUNT;
+    ptrFrame->isRepeat = false;
+    ptrFrame->tickPeriodDen = 0;
+}
+
+// Encode numLeds leds from ptrLedData (4 bytes per led: red, green, blue, bright) starting at firstLedIdx:
+void WriteLedFrameData(uint8_t firstLedIdx, const uint8_t *ptrLedData, uint8_t numLeds)
+{
+    for (uint8_t i = 0; i < numLeds && firstLedIdx + i < ELEKTRA_LED_COUNT; i++, ptrLedData += NB_CONFIG_BYTES_PER_LED)
+    {
+        _ledDataFrame.bitmap.red = ptrLedData[0];
+        _ledDataFrame.bitmap.green = ptrLedData[1];
+        _ledDataFrame.bitmap.blue = ptrLedData[2];
+        _ledDataFrame.bitmap.bright = ptrLedData[3];
+        _ledFrameRing[_u8LedRingHead].ledFrames[firstLedIdx + i] = _ledDataFrame.value;
+    }
+}
+
+// Queue live frame for the next PresentLedFrame():
+void CommitLedFrame()
+{
+    struct LedFrameBuffer *ptrFrame = &_ledFrameRing[_u8LedRingHead];
+
+    // Leds never written yet are switched off:
+    for (int ledIdx = 0; ledIdx < ELEKTRA_LED_COUNT; ledIdx++)
+    {
+        if (ptrFrame->ledFrames[ledIdx] == 0)
+        {
+            _ledDataFrame.bitmap.red = 0;
+            _ledDataFrame.bitmap.green = 0;
+            _ledDataFrame.bitmap.blue = 0;
+            _ledDataFrame.bitmap.bright = 0;
+            ptrFrame->ledFrames[ledIdx] = _ledDataFrame.value;
+        }
+    }
+
+    _isLedRingSlotRendered = true;
+    PushLedFrame();
+}
+
+bool IsLedFramePending()
+{
+    return _u8LedRingCount != 0;
+}
+
+#pragma endregion
+
 void SaveBrightnessCoefficient(uint16_t brightnessCoeff)
 {
     (void)brightnessCoeff;  // unused.
@@ -23,9 +23,27 @@
 #define INNER_LED_COUNT 4
 #define OUTER_LED_COUNT 8
 #define EDGE_LED_COUNT 8
+#define ELEKTRA_LED_COUNT (INNER_LED_COUNT + OUTER_LED_COUNT + EDGE_LED_COUNT)
 #define NB_CONFIG_BYTES_PER_LED 4		// 4 configuration bytes per led: red, green, blue, bright.
 #define TOTAL_LED_CONFIG_BUF_SZ (LED_COUNT * NB_CONFIG_BYTES_PER_LED)
 
 extern void LedPowerInit();
+extern void LedOutputInit();
+extern bool IsLedOutputBusy();
+extern uint32_t GetLedOutputCycles();
+extern void InvalidateLedFrameCache();
+extern bool PresentLedFrame();
+extern void DropLedFrame();
+extern void PushLedFrame();
+extern uint8_t GetLedFrameLead();
+extern bool IsLedFrameRingFull();
+extern uint8_t GetLedFrameRingSize();
+extern void SetLedFramePipeline(bool isEnabled);
+extern bool IsLedFramePipelineEnabled();
+extern void SetLedFrameTickPeriod(uint32_t periodNum, uint32_t periodDen);
+extern void BeginLedFrame();
+extern void WriteLedFrameData(uint8_t firstLedIdx, const uint8_t *ptrLedData, uint8_t numLeds);
+extern void CommitLedFrame();
+extern bool IsLedFramePending();
 
 #endif /* LEDSTRIP_DRIVER_H_ */
\ No newline at end of file
@@ -0,0 +1,133 @@
+/*
+ *  Copyright 2018-2021 ledmaker.org
+ *
+ *  This file is part of Elektra-SAMD21E18A.
+ *
+ *  Elektra-SAMD21E18A is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License,
+ *  or any later version.
+ *
+ *  Elektra-SAMD21E18A is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Elektra-SAMD21E18A. If not, see https://www.gnu.org/licenses/.
+ */
+
+#include "driver_init.h"
+#include "lz_decoder.h"
+#include "timer_handler.h"
+
+// Decoder benchmark (all LzDecode() calls since LzResetStats()):
+static uint32_t _u32LzCycles;
+static uint32_t _u32LzBytes;
+
+void LzInit(struct LzState *ptrState)
+{
+    ptrState->windowIdx = 0;
+    ptrState->phase = LzPhaseToken;
+    ptrState->count = 0;
+    ptrState->distance = 0;
+    ptrState->inPos = 0;
+    ptrState->outPos = 0;
+}
+
+// Decode compressed bytes from *pptrIn (up to ptrInEnd) into ptrOut until outLen bytes are produced or input runs out.
+// Tokens may be split across calls. Returns bytes produced, *pptrIn is advanced past the consumed input:
+uint32_t LzDecode(struct LzState *ptrState, const uint8_t **pptrIn, const uint8_t *ptrInEnd, uint8_t *ptrOut, uint32_t outLen)
+{
+    uint32_t startCycles = GetCycleCount();
+    const uint8_t *ptrIn = *pptrIn;
+    uint8_t *ptrOutEnd = ptrOut + outLen;
+    uint8_t *window = ptrState->window;
+    uint8_t windowIdx = ptrState->windowIdx;
+    uint8_t phase = ptrState->phase;
+    uint32_t count = ptrState->count;
+
+    // State is kept in locals, runs of literals and matches are copied in tight loops:
+    while (ptrOut != ptrOutEnd)
+    {
+        if (phase == LzPhaseLiteral)
+        {
+            uint32_t n = ptrOutEnd - ptrOut;
+            if (n > count) n = count;
+            if (n > (uint32_t)(ptrInEnd - ptrIn)) n = ptrInEnd - ptrIn;
+            if (!n) break;
+
+            count -= n;
+            while (n--)
+            {
+                uint8_t value = *ptrIn++;
+                window[windowIdx++] = value;
+                *ptrOut++ = value;
+            }
+        }
+        else if (phase == LzPhaseMatch)
+        {
+            uint32_t n = ptrOutEnd - ptrOut;
+            if (n > count) n = count;
+
+            uint8_t srcIdx = windowIdx - ptrState->distance - 1;
+            count -= n;
+            while (n--)
+            {
+                uint8_t value = window[srcIdx++];
+                window[windowIdx++] = value;
+                *ptrOut++ = value;
+            }
+        }
+        else
+        {
+            if (ptrIn == ptrInEnd) break;
+            uint8_t value = *ptrIn++;
+
+            if (phase == LzPhaseOffset)
+            {
+                ptrState->distance = value;
+                phase = LzPhaseMatch;
+                continue;
+            }
+
+            if (value & 0x80)
+            {
+                count = (value & 0x7F) + LZ_MATCH_MIN;
+                phase = LzPhaseOffset;
+            }
+            else
+            {
+                count = value + 1;
+                phase = LzPhaseLiteral;
+            }
+            continue;
+        }
+
+        if (!count) phase = LzPhaseToken;
+    }
+
+    uint32_t produced = outLen - (ptrOutEnd - ptrOut);
+    ptrState->windowIdx = windowIdx;
+    ptrState->phase = phase;
+    ptrState->count = count;
+    ptrState->inPos += ptrIn - *pptrIn;
+    ptrState->outPos += produced;
+    *pptrIn = ptrIn;
+
+    _u32LzCycles += GetCyclesElapsed(startCycles);
+    _u32LzBytes += produced;
+    return produced;
+}
+
+void LzResetStats(void)
+{
+    _u32LzCycles = 0;
+    _u32LzBytes = 0;
+}
+
+// Returns decode cycles per output byte (x100):
+uint32_t GetLzCyclesPerByte(void)
+{
+    return _u32LzBytes ? (uint64_t)_u32LzCycles * 100 / _u32LzBytes : 0;
+}
@@ -0,0 +1,54 @@
+/*
+ *  Copyright 2018-2021 ledmaker.org
+ *
+ *  This file is part of Elektra-SAMD21E18A.
+ *
+ *  Elektra-SAMD21E18A is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License,
+ *  or any later version.
+ *
+ *  Elektra-SAMD21E18A is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Elektra-SAMD21E18A. If not, see https://www.gnu.org/licenses/.
+ */
+
+#ifndef LZ_DECODER_H_
+#define LZ_DECODER_H_
+
+// Compressed animation format (byte-oriented lz77, decoded as a stream with a 256-byte window):
+//  0x00-0x7F: literal run, token + 1 literal bytes follow.
+//  0x80-0xFF: match of (token & 0x7F) + LZ_MATCH_MIN bytes, followed by one byte holding distance - 1 (1..256 back).
+#define LZ_WINDOW_SZ 256    // window index wraps as uint8_t.
+#define LZ_MATCH_MIN 3
+
+enum LzPhase
+{
+    LzPhaseToken = 0,
+    LzPhaseLiteral = 1,
+    LzPhaseOffset = 2,
+    LzPhaseMatch = 3
+};
+
+// Decoder state, may be copied to resume decoding from a saved position:
+struct LzState
+{
+    uint8_t window[LZ_WINDOW_SZ];    // last decoded bytes.
+    uint8_t windowIdx;    // next window write position.
+    uint8_t phase;
+    uint8_t count;    // remaining literal or match bytes.
+    uint8_t distance;    // match distance - 1.
+    uint32_t inPos;    // compressed bytes consumed.
+    uint32_t outPos;    // bytes decoded.
+};
+
+extern void LzInit(struct LzState *ptrState);
+extern uint32_t LzDecode(struct LzState *ptrState, const uint8_t **pptrIn, const uint8_t *ptrInEnd, uint8_t *ptrOut, uint32_t outLen);
+extern void LzResetStats(void);
+extern uint32_t GetLzCyclesPerByte(void);
+
+#endif /* LZ_DECODER_H_ */
@@ -23,18 +23,31 @@
 #include "atmel_start_pins.h"
 #include "ledstrip_driver.h"
 #include "timer_handler.h"
+#include "flash_handler.h"
+#include "lz_decoder.h"
 
 #pragma region Defines
 
 #define ON 1
 #define OFF 0
 #define Pc2Dev_Control 0
+#define USB_PACKET_SZ 64    // hid report size.
+#define USB_PACKET_RING_SZ 8    // power of 2.
+#define USB_PACKET_SLOTS (USB_PACKET_RING_SZ - 2)    // data packets, the last free slot is kept for a break packet.
+#define USB_BULK_BUF_SZ 256    // one nvm row per bulk transfer (multiple of bulk packet size).
+#define USB_BULK_BUFFERS 2    // power of 2, one buffer is received while the other is stored.
+#define LIVE_HEADER_SZ 4    // frame sequence (2 bytes), first led index, led count (bit 7 latches frame).
+#define LIVE_LATCH_BIT 0x80
+#define STATUS_PAGE_BYTE 63    // last status report byte holds the page number.
+#define STATUS_PAGES 4
+#define TICK_BACKLOG_MAX_US 1000000    // catch-up backlog is capped at one second of ticks, older missed ticks are dropped.
+#define LZ_SCRATCH_SZ 64    // decoded bytes discarded per step when a compressed nvm upload is measured.
 
 #pragma endregion
 
 #pragma region Definitions/declarations
 
-static uint8_t u8SramBuffer[SRAM_BUF_SZ];
+static uint8_t u8SramBuffer[SRAM_BUF_SZ] __attribute__((aligned(4)));    // word-aligned for FlashCopyWords().
 uint8_t *ptrSramBufferStart = u8SramBuffer;
 uint8_t *ptrSram;
 uint32_t ptrNvm;
@@ -51,6 +64,7 @@ enum PacketFlag
 {
     ControlFlag = 0,
     StoreFlag = 1,
+    LiveFlag = 2,
 };
 static volatile enum PacketFlag packetFlag;
 
@@ -59,37 +73,418 @@ static bool isActiveAnimation;
 static bool isActiveMemWrite;
 static volatile bool isSaveToRom;
 
+// Usb packet ring (single producer usb interrupt, single consumer main loop):
+struct UsbPacketSlot
+{
+    uint8_t data[USB_PACKET_SZ];
+    uint8_t len;
+    bool isBreak;
+    uint32_t rxCycles;    // cycle count at receipt (live frame latency).
+};
+static struct UsbPacketSlot _usbPacketRing[USB_PACKET_RING_SZ];
+static volatile uint8_t _usbPacketHead;    // written by usb interrupt only.
+static volatile uint8_t _usbPacketTail;    // written by main loop only.
+static volatile bool _isUsbBreakPending;    // break packet received while ring was full.
+static volatile uint8_t _u8UsbPacketHighWater;    // max ring fill since start of store sequence.
+static volatile uint16_t _u16UsbPacketOverflows;    // packets dropped on full ring since start of store sequence.
+
+// Interrupt out endpoint (streaming upload, one 64-byte report per frame):
+static uint8_t _u8UsbOutBuffer[USB_PACKET_SZ] COMPILER_ALIGNED(4);    // received packet, copied from the bank of the dual-bank ep1 cache.
+static volatile bool _isUsbOutArmed;
+static uint16_t _u16UsbOutWindowFrame;    // usb frame number at start of throughput window.
+static uint16_t _u16UsbOutLastFrame;
+static uint32_t _u32UsbOutWindowBytes;
+static uint32_t _u32UsbOutBytesPerSec;    // sustained out endpoint throughput of last full window.
+
+// Vendor bulk out endpoint (fast upload of storage data, received directly into row-sized buffers):
+static uint8_t _u8UsbBulkBuffers[USB_BULK_BUFFERS][USB_BULK_BUF_SZ] COMPILER_ALIGNED(4);
+static volatile uint16_t _u16UsbBulkLen[USB_BULK_BUFFERS];    // received bytes, 0 while buffer is free.
+static volatile bool _isUsbBulkArmed;
+static uint8_t _u8UsbBulkArmIdx;    // buffer of next bulk transfer (usb interrupt only).
+static uint8_t _u8UsbBulkDrainIdx;    // buffer of next storage (main loop only).
+static uint16_t _u16UsbBulkDiscards;    // bulk transfers received outside a store sequence.
+
+// Upload timing (first storage byte until last byte is programmed):
+enum UploadPath
+{
+    UploadPathHid = 0,
+    UploadPathBulk = 1,
+};
+static uint32_t _u32UploadBytes;
+static uint32_t _u32UploadStartMs;
+static uint32_t _u32UploadMs;
+static enum UploadPath _uploadPath;
+static bool _isUploadFinishing;    // store sequence terminated, waiting for nvm programming.
+static bool _isNvmAppendPending;    // nvm upload terminated, its library slot is recorded once programming completes.
+static bool _isUploadCompressed;    // upload is in lz_decoder.h format (sram uploads are decompressed on arrival, nvm uploads are stored as is and decoded only to count their raw length).
+static struct LzState _uploadLz;
+static bool _isSramUploadFailed;    // last sram upload (decompressed) exceeded SRAM_BUF_SZ, the remainder was dropped.
+
+// Backing store of running animation (an nvm animation that fits into sram is copied there at boot):
+enum BackingStore
+{
+    BackingNvm = 0,
+    BackingSram = 1,    // uploaded to sram.
+    BackingSramCache = 2,    // copied from nvm at boot.
+};
+static bool _isNvmCached;    // sram holds copy of nvm animation.
+static uint32_t _u32NvmCacheCycles;    // boot copy time.
+static uint32_t _u32DecodeCyclesNvm;    // last frame decoded from nvm.
+static uint32_t _u32DecodeCyclesSram;    // last frame decoded from sram.
+
+// Nvm animation library (nvm uploads are appended to a new slot, stored slots are selected without an upload):
+static uint32_t _u32NvmAppendAddr;    // slot start of current nvm upload (0 if no space was free).
+static uint32_t _u32UploadNameHash;
+static bool _isNvmAppendFailed;    // last nvm upload did not fit its gap, found no free slot or failed programming.
+static uint32_t _u32SlotSwitchCycles;    // last slot selection until playback could start.
+
+// Live frame streaming (host frames are written straight into the led frame ring and latched on the next usb frame):
+static uint16_t _u16LiveFrameSeq;    // sequence of frame being assembled or last committed.
+static bool _isLiveSeqValid;    // a frame has been received since live mode was entered.
+static bool _isLiveFrameOpen;    // fragments of _u16LiveFrameSeq are being written.
+static uint32_t _u32LiveRxCycles;    // receipt of latch fragment of pending frame.
+static uint32_t _u32LiveLatchMs;
+static uint16_t _u16LiveFramesShown;
+static uint16_t _u16LivePacketsDropped;    // late or duplicate frame packets.
+static uint16_t _u16LiveFramesDropped;    // frames superseded before being latched or never completed.
+static uint32_t _u32LiveLatencyCycles;    // usb receipt to latch of last frame (wraps after 349ms).
+static uint32_t _u32LiveLatencyMaxCycles;
+
+static uint8_t _u8StatusPage;    // status report page selected by host.
+
+// Stored animations play from rtc ticks with standby sleep between frames while no usb host is present:
+static bool _isLowPowerPlayback = true;
+
+// Frame deadline overruns (render and output of a frame took longer than its tick):
+enum OverrunPolicy
+{
+    OverrunSkip = 0,    // drop frames of missed ticks (keeps wall-clock timing).
+    OverrunCatchUp = 1,    // present frames of missed ticks back-to-back (keeps every frame).
+};
+static enum OverrunPolicy _overrunPolicy;
+static uint16_t _u16TickBacklog;    // missed ticks still to be caught up.
+static uint8_t _u8SkipTicks;    // missed ticks to be skipped at next render.
+static uint16_t _u16OverrunCount;    // overrun frames since animation start.
+static uint8_t _u8OverrunMaxTicks;    // worst overrun (missed ticks) since animation start.
+static uint32_t _u32SkippedFrames;
+static uint32_t _u32CaughtUpFrames;
+
+// Frames rendered ahead of the tick (decode jitter is absorbed by the led frame ring):
+static bool _isAnimationEnded;    // decoder finished, frames still in the ring are presented.
+static uint8_t _u8LedFrameLead;    // frames rendered ahead at last tick.
+static uint8_t _u8LedFrameLeadMin;    // since animation start.
+static uint16_t _u16RenderUnderruns;    // ticks without a frame rendered ahead.
+
 #pragma endregion
 
 #pragma region USB reports
 
-static void UsbInputReportCallback (uint8_t *ptrUsbBuf, uint16_t usbBufLen)
+static uint8_t GetUsbPacketCount(void)
+{
+    return (_usbPacketHead - _usbPacketTail) & (USB_PACKET_RING_SZ - 1);
+}
+
+static void EnqueueUsbPacket (uint8_t *ptrUsbBuf, uint16_t usbBufLen)
 {
 	// Check for break-packet (all buffer bytes 0xFF):
 	uint8_t i;
 	bool isBreakPacket = true;
 	for (i = 0; i < usbBufLen; i++) if (ptrUsbBuf[i] != 0xFF) isBreakPacket = false;
 
-    // Handle break packet (halts any current animation and sets controller to listen for control packets):
+    // Break packet halts any current animation immediately (store sequence is terminated in order by main loop):
+    if (isBreakPacket)
+    {
+        animationFlag = Stop;
+    }
+    else if (isActiveAnimation)
+    {
+        return;  // ignore non-break packets when an animation is running.
+    }
+
+    // Packets following a latched break would be processed before it (and stored as upload data), they are dropped:
+    if (_isUsbBreakPending)
+    {
+        if (!isBreakPacket) _u16UsbPacketOverflows++;
+        return;
+    }
+
+    // Enqueue packet for main loop (a break packet may take the reserved slot):
+    uint8_t nextHead = (_usbPacketHead + 1) & (USB_PACKET_RING_SZ - 1);
+    if (!isBreakPacket && GetUsbPacketCount() >= USB_PACKET_SLOTS)
+    {
+        _u16UsbPacketOverflows++;
+        return;
+    }
+    if (nextHead == _usbPacketTail)
+    {
+        _isUsbBreakPending = true;    // break is never dropped.
+        return;
+    }
+
+    struct UsbPacketSlot *ptrSlot = &_usbPacketRing[_usbPacketHead];
+    if (usbBufLen > USB_PACKET_SZ) usbBufLen = USB_PACKET_SZ;
+    memcpy(ptrSlot->data, ptrUsbBuf, usbBufLen);
+    ptrSlot->len = usbBufLen;
+    ptrSlot->isBreak = isBreakPacket;
+    ptrSlot->rxCycles = GetCycleCount();
+    __DMB();    // slot must be complete before it is published.
+    _usbPacketHead = nextHead;
+
+    uint8_t count = GetUsbPacketCount();
+    if (count > _u8UsbPacketHighWater) _u8UsbPacketHighWater = count;
+}
+
+// Control pipe upload (hid set_report):
+static void UsbInputReportCallback (uint8_t *ptrUsbBuf, uint16_t usbBufLen)
+{
+    EnqueueUsbPacket(ptrUsbBuf, usbBufLen);
+}
+
+// Interrupt out endpoint upload (endpoint is re-armed only while ring has a free slot, otherwise host is nak'ed until main loop drains ring).
+// Call from usb interrupt or with interrupts masked:
+static void ArmUsbOutEndpoint(void)
+{
+    if (!_isUsbOutArmed && GetUsbPacketCount() < USB_PACKET_SLOTS)
+    {
+        _isUsbOutArmed = (hiddf_generic_read(_u8UsbOutBuffer, USB_PACKET_SZ) == ERR_NONE);
+    }
+}
+
+// Measure sustained out endpoint throughput over windows of ~1 s of back-to-back packets (a gap of more than 10 frames restarts window):
+static void MeasureUsbOutThroughput(uint32_t count)
+{
+    uint16_t frameNum = usb_d_get_frame_num();
+    uint16_t windowFrames = (frameNum - _u16UsbOutWindowFrame) & 0x7FF;    // 11-bit frame counter.
+
+    if (((frameNum - _u16UsbOutLastFrame) & 0x7FF) > 10)
+    {
+        _u16UsbOutWindowFrame = frameNum;
+        _u32UsbOutWindowBytes = 0;
+    }
+    else if (windowFrames >= 1000)
+    {
+        _u32UsbOutBytesPerSec = _u32UsbOutWindowBytes * 1000 / windowFrames;
+        _u16UsbOutWindowFrame = frameNum;
+        _u32UsbOutWindowBytes = 0;
+    }
+
+    _u32UsbOutWindowBytes += count;
+    _u16UsbOutLastFrame = frameNum;
+}
+
+static bool UsbOutEndpointCallback(const uint8_t ep, const enum usb_xfer_code code, void *param)
+{
+    (void)ep;
+    _isUsbOutArmed = false;
+    if (code == USB_XFER_DONE)
+    {
+        MeasureUsbOutThroughput((uint32_t)param);
+        EnqueueUsbPacket(_u8UsbOutBuffer, (uint32_t)param);
+    }
+    ArmUsbOutEndpoint();
+    return false;
+}
+
+// Vendor bulk upload (buffer is re-armed only once it has been stored, otherwise host is nak'ed).
+// Call from usb interrupt or with interrupts masked:
+static void ArmUsbBulkEndpoint(void)
+{
+    if (!_isUsbBulkArmed && !_u16UsbBulkLen[_u8UsbBulkArmIdx])
+    {
+        _isUsbBulkArmed = (vendordf_read(_u8UsbBulkBuffers[_u8UsbBulkArmIdx], USB_BULK_BUF_SZ) == ERR_NONE);
+    }
+}
+
+// Transfer completes on a full buffer or a short packet (host ends an upload that is not a multiple of USB_BULK_BUF_SZ with a short or zero-length packet):
+static bool UsbBulkOutCallback(const uint8_t ep, const enum usb_xfer_code code, void *param)
+{
+    (void)ep;
+    _isUsbBulkArmed = false;
+    if (code == USB_XFER_DONE && (uint32_t)param)
+    {
+        _u16UsbBulkLen[_u8UsbBulkArmIdx] = (uint32_t)param;
+        _u8UsbBulkArmIdx = (_u8UsbBulkArmIdx + 1) & (USB_BULK_BUFFERS - 1);
+    }
+    ArmUsbBulkEndpoint();
+    return false;
+}
+
+static bool IsUsbBulkPending(void)
+{
+    return _u16UsbBulkLen[_u8UsbBulkDrainIdx] != 0;
+}
+
+// Copy active nvm animation into sram if it fits and its crc is intact, returns false to play from nvm.
+// A compressed animation is checked in place and decompressed into sram:
+static bool CacheNvmAnimation(void)
+{
+    uint32_t length = GetNvmAnimationRawLength();
+    if (!length || length > SRAM_BUF_SZ) return false;
+
+    uint32_t startCycles = GetCycleCount();
+    if (!IsNvmAnimationIntact()) return false;
+
+    if (IsNvmAnimationCompressed())
+    {
+        const uint8_t *ptrIn = (const uint8_t *)GetNvmAnimationAddr();
+        uint32_t storedLength = GetNvmAnimationLength();
+
+        LzInit(&_uploadLz);
+        LzResetStats();
+        if (LzDecode(&_uploadLz, &ptrIn, ptrIn + storedLength, u8SramBuffer, length) != length) return false;
+    }
+    else FlashCopyWords((uint32_t *)u8SramBuffer, GetNvmAnimationAddr(), length);
+    _u32NvmCacheCycles = GetCyclesElapsed(startCycles);
+
+    ptrSram = ptrSramBufferStart + length;
+    _isNvmCached = true;
+    return true;
+}
+
+// Store data of current store sequence (hid packets and bulk transfers):
+static void StoreUploadData(const uint8_t *ptrData, uint16_t length, enum UploadPath path)
+{
+    isActiveMemWrite = true;
+
+    if (!_u32UploadBytes)
+    {
+        _u32UploadStartMs = GetMsCount();
+        _uploadPath = path;
+    }
+    _u32UploadBytes += length;
+
+    if (!isSaveToRom)    // store to sram.
+    {
+        uint32_t freeLength = ptrSramBufferStart + SRAM_BUF_SZ - ptrSram;
+
+        if (_isUploadCompressed)
+        {
+            const uint8_t *ptrDataEnd = ptrData + length;
+            ptrSram += LzDecode(&_uploadLz, &ptrData, ptrDataEnd, ptrSram, freeLength);
+
+            // Output stopped at end of buffer with input or match bytes left:
+            if (ptrSram == ptrSramBufferStart + SRAM_BUF_SZ && (ptrData != ptrDataEnd || _uploadLz.phase == LzPhaseMatch)) _isSramUploadFailed = true;
+        }
+        else
+        {
+            if (length > freeLength)
+            {
+                length = freeLength;
+                _isSramUploadFailed = true;
+            }
+            memcpy(ptrSram, ptrData, length);	// write packet bytes to instruction buffer.
+            ptrSram += length;	// set instruction buffer write pointer to next unfilled buffer byte.
+        }
+    }
+    else if (isSaveToRom) // store to nvm.
+    {
+        // Clip data beyond free gap (the following slot must not be overwritten):
+        if (length > GetNvmAppendLimit() - ptrNvm)
+        {
+            length = GetNvmAppendLimit() - ptrNvm;
+            _isNvmAppendFailed = true;
+        }
+        NvmWriterWrite(ptrData, length);    // staged per row, programmed asynchronously.
+        ptrNvm += length;
+
+        // Measure decompressed length as packets arrive (spread over the upload instead of one pass at its end):
+        if (_isUploadCompressed)
+        {
+            uint8_t scratch[LZ_SCRATCH_SZ];
+            const uint8_t *ptrDataEnd = ptrData + length;
+            while (LzDecode(&_uploadLz, &ptrData, ptrDataEnd, scratch, LZ_SCRATCH_SZ));
+        }
+    }
+
+    isActiveMemWrite = false;
+}
+
+// Write live frame fragment into led frame ring, frames are committed by a fragment with the latch bit.
+// A frame (20 leds, 4 bytes each) spans 2 reports of up to 15 leds:
+static void ProcessLiveFramePacket(const uint8_t *ptrUsbBuf, uint16_t usbBufLen, uint32_t rxCycles)
+{
+    if (usbBufLen < LIVE_HEADER_SZ) return;
+
+    uint16_t seq = ptrUsbBuf[0] | (ptrUsbBuf[1] << 8);
+    uint8_t firstLedIdx = ptrUsbBuf[2];
+    uint8_t numLeds = ptrUsbBuf[3] & ~LIVE_LATCH_BIT;
+    bool isLatch = ptrUsbBuf[3] & LIVE_LATCH_BIT;
+    if (numLeds > (usbBufLen - LIVE_HEADER_SZ) / NB_CONFIG_BYTES_PER_LED) numLeds = (usbBufLen - LIVE_HEADER_SZ) / NB_CONFIG_BYTES_PER_LED;
+
+    // Start of a new frame:
+    if (!_isLiveFrameOpen || seq != _u16LiveFrameSeq)
+    {
+        // Drop late and duplicate frames (sequence compared modulo 2^16):
+        if (_isLiveSeqValid && (int16_t)(seq - _u16LiveFrameSeq) <= 0)
+        {
+            _u16LivePacketsDropped++;
+            return;
+        }
+
+        if (_isLiveFrameOpen || IsLedFramePending()) _u16LiveFramesDropped++;
+        BeginLedFrame();
+        _u16LiveFrameSeq = seq;
+        _isLiveSeqValid = true;
+        _isLiveFrameOpen = true;
+    }
+
+    WriteLedFrameData(firstLedIdx, &ptrUsbBuf[LIVE_HEADER_SZ], numLeds);
+
+    if (isLatch)
+    {
+        CommitLedFrame();
+        _isLiveFrameOpen = false;
+        _u32LiveRxCycles = rxCycles;
+    }
+}
+
+// Present pending live frame on usb frame boundary:
+static void LatchLiveFrame(void)
+{
+    uint32_t msCount = GetMsCount();
+    if (msCount == _u32LiveLatchMs) return;
+    _u32LiveLatchMs = msCount;
+
+    if (!IsLedFramePending()) return;
+
+    PresentLedFrame();
+    _u16LiveFramesShown++;
+    _u32LiveLatencyCycles = GetCyclesElapsed(_u32LiveRxCycles);
+    if (_u32LiveLatencyCycles > _u32LiveLatencyMaxCycles) _u32LiveLatencyMaxCycles = _u32LiveLatencyCycles;
+}
+
+static void ProcessUsbPacket (uint8_t *ptrUsbBuf, uint16_t usbBufLen, bool isBreakPacket, uint32_t rxCycles)
+{
+    // Handle break packet (sets controller to listen for control packets):
 	if (isBreakPacket)
 	{
+        // Break packet also terminates a store sequence:
+        if (packetFlag == StoreFlag)
+        {
+            if (isSaveToRom) NvmWriterFlush();
+            _isUploadFinishing = (_u32UploadBytes != 0);    // upload time is taken once nvm programming completes.
+            _isNvmAppendPending = isSaveToRom;
+        }
+
+        // Break packet also terminates live mode (an incomplete frame is discarded):
+        if (packetFlag == LiveFlag && _isLiveFrameOpen)
+        {
+            _isLiveFrameOpen = false;
+            _u16LiveFramesDropped++;
+        }
+
     	animationFlag = Stop;
 		packetFlag = ControlFlag;
 		return;
 	}
 
-    if (isActiveAnimation || isActiveMemWrite)
-    {
-        return;  // ignore non-break packets when an animation is running or a memory write is in-progress.
-    }
-
     // Handle control packet:
     if (packetFlag == ControlFlag)
     {
         if ((*ptrUsbBuf >> 4) != Pc2Dev_Control) return;  // check first byte is control instruction.
 
-	    // Parse control instruction:
-	    isSaveToRom = *ptrUsbBuf & 0x08;
+	    // Parse control instruction (store bit only applies to start, store and slot select, other opcodes keep the backing):
+	    bool isStoreBit = *ptrUsbBuf & 0x08;
 	    uint8_t ctrlOpcode = *ptrUsbBuf & 0x07;
 
 	    // Executing control instruction...
@@ -100,61 +495,358 @@ static void UsbInputReportCallback (uint8_t *ptrUsbBuf, uint16_t usbBufLen)
         }
         else if (ctrlOpcode == 1)    // resume animation.
         {
+            if (isSaveToRom && GetNvmActiveSlot() == NVM_SLOT_NONE) return;    // active slot was deleted.
+            ResetElapsedTicks();    // ticks of the pause are not overruns.
             animationFlag = Run;
         }
         else if (ctrlOpcode == 2)    // start animation.
         {
+            isSaveToRom = isStoreBit;
+            StopSyncTicks();    // ticks from free-running sof count.
             animationFlag = RunInit;
         }
         else if (ctrlOpcode == 3)    // store new packets.
         {
+            isSaveToRom = isStoreBit;
             animationFlag = Stop;  // redundant since accomplished by break packet.
             packetFlag = StoreFlag;
 
+            // Reset packet ring counters for new store sequence:
+            CRITICAL_SECTION_ENTER();
+            _u8UsbPacketHighWater = GetUsbPacketCount();
+            _u16UsbPacketOverflows = 0;
+            CRITICAL_SECTION_LEAVE();
+
+            // Reset upload timing:
+            _u32UploadBytes = 0;
+            _u32UploadMs = 0;
+            _isUploadFinishing = false;
+
+            // Byte 1 bit 0 flags a compressed upload, bytes 2-5 hold the name hash of an nvm upload:
+            _isUploadCompressed = usbBufLen > 1 && (ptrUsbBuf[1] & 0x01);
+            _u32UploadNameHash = (usbBufLen > 5) ? ptrUsbBuf[2] | (ptrUsbBuf[3] << 8) | (ptrUsbBuf[4] << 16) | ((uint32_t)ptrUsbBuf[5] << 24) : 0;
+            LzInit(&_uploadLz);
+            LzResetStats();
+
             if (!isSaveToRom)    // store subsequent packets to sram.
             {
                 // Sram init:
                 ptrSram = ptrSramBufferStart;	// set sram pointer to start of available sram region.
+                _isNvmCached = false;
+                _isSramUploadFailed = false;
             }
             else if (isSaveToRom) // store to nvm.
             {
-                // Nvm init:
-                ptrNvm = NVM_BUF_START_ADDR;	// set nvm pointer to start of free flash region.
-		        //flash_erase(&FLASH_0, NVM_BUF_START_ADDR, NVM_BUF_PAGES_COUNT);   // only useful if debugging memory.
+                // Nvm init (stored slots are kept, the upload goes to the largest free gap):
+                _u32NvmAppendAddr = NvmAppendBegin();
+                ptrNvm = _u32NvmAppendAddr;	// set nvm pointer to start of free flash region.
+                if (ptrNvm) NvmWriterBegin(ptrNvm);    // rows are erased as the writer reaches them.
+                _isNvmAppendPending = false;
+                _isNvmAppendFailed = false;
             }
 
             // Set default light pattern:
             SetLedstripTestColor(5, 5, 5, 1);
         }
+        else if (ctrlOpcode == 4)    // stream live frames.
+        {
+            animationFlag = Stop;  // redundant since accomplished by break packet.
+            packetFlag = LiveFlag;
+
+            _isLiveSeqValid = false;
+            _isLiveFrameOpen = false;
+            _u16LiveFramesShown = 0;
+            _u16LivePacketsDropped = 0;
+            _u16LiveFramesDropped = 0;
+            _u32LiveLatencyMaxCycles = 0;
+
+            SetLedFramePipeline(true);    // frames are presented on usb frames.
+        }
+        else if (ctrlOpcode == 5)    // start animation synchronized to usb frame number (bytes 1-2, 11 bits).
+        {
+            if (usbBufLen < 3) return;
+            isSaveToRom = isStoreBit;
+            StartSyncTicks(ptrUsbBuf[1] | (ptrUsbBuf[2] << 8));    // boards on the same bus render the same tick on the same frame.
+            animationFlag = RunInit;
+        }
+        else if (ctrlOpcode == 6)    // select status report page (byte 1).
+        {
+            _u8StatusPage = (usbBufLen > 1 && ptrUsbBuf[1] < STATUS_PAGES) ? ptrUsbBuf[1] : 0;
+        }
+        else if (ctrlOpcode == 7)    // configure setting (byte 1) to value (byte 2).
+        {
+            if (usbBufLen < 3) return;
+            if (ptrUsbBuf[1] == 0) _overrunPolicy = ptrUsbBuf[2] ? OverrunCatchUp : OverrunSkip;
+            else if (ptrUsbBuf[1] == 1) _isLowPowerPlayback = ptrUsbBuf[2];
+            else if (ptrUsbBuf[1] == 2)    // select library slot and start it (save bit also plays it after reset).
+            {
+                if (IsNvmBusy()) return;    // upload still being programmed.
+
+                uint32_t startCycles = GetCycleCount();
+                if (!NvmSelectSlot(ptrUsbBuf[2], isStoreBit)) return;
+                isSaveToRom = !CacheNvmAnimation();
+                _u32SlotSwitchCycles = GetCyclesElapsed(startCycles);
+
+                StopSyncTicks();
+                animationFlag = RunInit;
+            }
+            else if (ptrUsbBuf[1] == 3)    // delete library slot (0xFF deletes all).
+            {
+                if (ptrUsbBuf[2] == GetNvmActiveSlot() || ptrUsbBuf[2] == NVM_SLOT_NONE) animationFlag = Stop;
+                NvmDeleteSlot(ptrUsbBuf[2]);
+            }
+        }
     }
 
 	// Handle storage packet:
 	else if (packetFlag == StoreFlag)
 	{
-    	isActiveMemWrite = true;
-
-        if (!isSaveToRom)    // store to sram.
-    	{
-        	memcpy(ptrSram, ptrUsbBuf, usbBufLen);	// write packet bytes to instruction buffer.
-        	ptrSram += usbBufLen;	// set instruction buffer write pointer to next unfilled buffer byte.
-    	}
-    	else if (isSaveToRom) // store to nvm.
-    	{
-		    flash_write(&FLASH_0, ptrNvm, ptrUsbBuf, usbBufLen);
-		    ptrNvm += usbBufLen;
+        StoreUploadData(ptrUsbBuf, usbBufLen, UploadPathHid);
+    }
+
+    // Handle live frame packet:
+    else if (packetFlag == LiveFlag)
+    {
+        ProcessLiveFramePacket(ptrUsbBuf, usbBufLen, rxCycles);
+    }
+}
+
+// Store received bulk transfers (bulk data outside a store sequence is discarded once all queued control packets have been processed):
+static void DrainUsbBulk(void)
+{
+    while (IsUsbBulkPending())
+    {
+        uint16_t len = _u16UsbBulkLen[_u8UsbBulkDrainIdx];
+
+        if (packetFlag == StoreFlag)
+        {
+            if (isSaveToRom && !IsNvmWriterReady(len)) return;
+            StoreUploadData(_u8UsbBulkBuffers[_u8UsbBulkDrainIdx], len, UploadPathBulk);
+        }
+        else
+        {
+            if (GetUsbPacketCount()) return;    // queued control packet may start a store sequence.
+            _u16UsbBulkDiscards++;
         }
 
-        isActiveMemWrite = false;
+        __DMB();    // buffer must be consumed before it is released.
+        _u16UsbBulkLen[_u8UsbBulkDrainIdx] = 0;
+        _u8UsbBulkDrainIdx = (_u8UsbBulkDrainIdx + 1) & (USB_BULK_BUFFERS - 1);
+    }
+}
+
+// Dispatch queued usb packets (nvm storage packets wait while nvm writer has no free row buffer):
+static void DrainUsbPackets(void)
+{
+    while (GetUsbPacketCount())
+    {
+        struct UsbPacketSlot *ptrSlot = &_usbPacketRing[_usbPacketTail];
+
+        if (!ptrSlot->isBreak && packetFlag == StoreFlag && isSaveToRom && !IsNvmWriterReady(ptrSlot->len)) return;
+        if (ptrSlot->isBreak && packetFlag == StoreFlag && IsUsbBulkPending()) return;    // bulk data precedes break.
+
+        ProcessUsbPacket(ptrSlot->data, ptrSlot->len, ptrSlot->isBreak, ptrSlot->rxCycles);
+        __DMB();    // slot must be consumed before it is released.
+        _usbPacketTail = (_usbPacketTail + 1) & (USB_PACKET_RING_SZ - 1);
+    }
+
+    // Break packet received on full ring is processed after all preceding packets:
+    if (_isUsbBreakPending && !(packetFlag == StoreFlag && IsUsbBulkPending()))
+    {
+        _isUsbBreakPending = false;
+        ProcessUsbPacket(NULL, 0, true, 0);
+    }
+}
+
+static void PutStatusU16(uint8_t *ptrStatus, uint16_t value)
+{
+    ptrStatus[0] = value;
+    ptrStatus[1] = value >> 8;
+}
+
+static void PutStatusU32(uint8_t *ptrStatus, uint32_t value)
+{
+    ptrStatus[0] = value;
+    ptrStatus[1] = value >> 8;
+    ptrStatus[2] = value >> 16;
+    ptrStatus[3] = value >> 24;
+}
+
+// Status page 0: upload, live frame and frame sync counters.
+static void PutStatusPage0(uint8_t *usb_buf)
+{
+    // Send performance counters to host (little-endian):
+    PutStatusU32(&usb_buf[3], GetLedOutputCycles());    // cpu cycles of last led frame output.
+    PutStatusU16(&usb_buf[7], GetNvmEraseCount());    // nvm row erases of last upload.
+    PutStatusU16(&usb_buf[9], GetNvmJobErrorCount());    // failed nvm commands and verify mismatches of last upload.
+
+    // Send packet ring state to host (host should hold off while ring is nearly full):
+    usb_buf[11] = GetUsbPacketCount();
+    usb_buf[12] = USB_PACKET_SLOTS;    // usable slots.
+    usb_buf[13] = _u8UsbPacketHighWater;
+    PutStatusU16(&usb_buf[14], _u16UsbPacketOverflows);
+    PutStatusU32(&usb_buf[16], _u32UsbOutBytesPerSec);    // sustained interrupt out upload rate (bytes/s).
+
+    // Send upload timing to host (time is 0 until last byte has been stored):
+    PutStatusU32(&usb_buf[20], _u32UploadBytes);
+    PutStatusU32(&usb_buf[24], _u32UploadMs);
+    usb_buf[28] = _uploadPath;
+    PutStatusU16(&usb_buf[29], _u16UsbBulkDiscards);
+
+    // Send live frame counters to host:
+    PutStatusU16(&usb_buf[31], _u16LiveFramesShown);
+    PutStatusU16(&usb_buf[33], _u16LivePacketsDropped);
+    PutStatusU16(&usb_buf[35], _u16LiveFramesDropped);
+    PutStatusU32(&usb_buf[37], _u32LiveLatencyCycles);    // cpu cycles from usb receipt to latch.
+    PutStatusU32(&usb_buf[41], _u32LiveLatencyMaxCycles);
+
+    // Send frame sync state to host (host compares tick counts of boards for the same frame number):
+    PutStatusU32(&usb_buf[45], GetSyncTickCount());
+    PutStatusU32(&usb_buf[49], GetSyncDrift());    // sof interrupts minus elapsed frames (missed sofs).
+    PutStatusU16(&usb_buf[53], GetSyncPhaseError());    // frames from tick to render start.
+    PutStatusU16(&usb_buf[55], GetSyncPhaseErrorMax());
+    usb_buf[57] = IsSyncTicks();
+    PutStatusU16(&usb_buf[58], usb_d_get_frame_num());
+
+    // Send calibrated rtc frequency (Hz, 24 bits) of low-power playback to host:
+    uint32_t rtcFreqHz = GetRtcFrequency();
+    usb_buf[60] = rtcFreqHz;
+    usb_buf[61] = rtcFreqHz >> 8;
+    usb_buf[62] = rtcFreqHz >> 16;
+}
+
+// Status page 1: timebase and tick pacing.
+static void PutStatusPage1(uint8_t *usb_buf)
+{
+    // Send timebase state to host (timer stands in for missing sofs):
+    usb_buf[3] = IsTimerTimebase();
+    PutStatusU16(&usb_buf[4], GetSofToTimerCount());
+    PutStatusU16(&usb_buf[6], GetTimerToSofCount());
+    PutStatusU32(&usb_buf[8], GetTimerMsCount());    // milliseconds counted by timer.
+    PutStatusU32(&usb_buf[12], GetMsCount());
+
+    // Send tick pacing to host (tick to tick interval measured with the cycle counter):
+    PutStatusU32(&usb_buf[16], GetTickIntervalUs());
+    PutStatusU32(&usb_buf[20], GetTickPacingError());    // us, measured minus nominal interval of last tick.
+    PutStatusU32(&usb_buf[24], GetTickPacingErrorMax());
+    PutStatusU32(&usb_buf[28], GetTickPacingDrift());    // us, sum of pacing errors since interval was set.
+    PutStatusU32(&usb_buf[32], GetSyncTickCount());
+
+    // Send frame deadline overruns of current animation to host:
+    PutStatusU16(&usb_buf[36], _u16OverrunCount);
+    usb_buf[38] = _u8OverrunMaxTicks;    // worst overrun in ticks.
+    PutStatusU32(&usb_buf[39], _u32SkippedFrames);
+    PutStatusU32(&usb_buf[43], _u32CaughtUpFrames);
+    usb_buf[47] = _overrunPolicy;
+
+    // Send cpu load to host:
+    PutStatusU16(&usb_buf[48], GetIdlePermille());    // idle time of last second (1/1000).
+    PutStatusU32(&usb_buf[50], GetActiveCyclesPerSec());
+
+    // Send low-power playback state to host (page is full):
+    usb_buf[54] = IsRtcTimebase() | (IsStandbyDisabled() << 1);
+    PutStatusU16(&usb_buf[55], GetWakeLatency());    // us, rtc tick to frame output.
+    PutStatusU16(&usb_buf[57], GetWakeLatencyMax());
+    PutStatusU32(&usb_buf[59], GetStandbyCount());
+}
+
+// Status page 2: power.
+static void PutStatusPage2(uint8_t *usb_buf)
+{
+    // Send clock governor state and energy estimate of last second to host:
+    usb_buf[3] = GetPerfLevel();
+    PutStatusU16(&usb_buf[4], GetPerfLevelPermille(PerfLevelLow));    // awake time per level (1/1000).
+    PutStatusU16(&usb_buf[6], GetPerfLevelPermille(PerfLevelMid));
+    PutStatusU16(&usb_buf[8], GetPerfLevelPermille(PerfLevelFull));
+    PutStatusU32(&usb_buf[10], GetFrameEnergy());    // nJ per tick.
+    PutStatusU32(&usb_buf[14], GetAveragePower());    // uW.
+
+    // Send backing store and decode time per frame to host:
+    usb_buf[18] = isSaveToRom ? BackingNvm : (_isNvmCached ? BackingSramCache : BackingSram);
+    PutStatusU32(&usb_buf[19], _u32DecodeCyclesNvm);
+    PutStatusU32(&usb_buf[23], _u32DecodeCyclesSram);
+    PutStatusU32(&usb_buf[27], _u32NvmCacheCycles);
+
+    // Send render-ahead state of current animation to host:
+    usb_buf[43] = GetLedFrameRingSize();
+    usb_buf[44] = _u8LedFrameLead;    // frames ready at last tick.
+    usb_buf[45] = _u8LedFrameLeadMin;
+    PutStatusU16(&usb_buf[46], _u16RenderUnderruns);
+
+    // Send compression of stored animation and decompression cost to host:
+    uint32_t rawLength = GetNvmAnimationRawLength();
+    usb_buf[48] = IsNvmAnimationCompressed();
+    PutStatusU32(&usb_buf[49], rawLength);
+    PutStatusU16(&usb_buf[53], rawLength ? (uint16_t)((uint64_t)GetNvmAnimationLength() * 1000 / rawLength) : 0);    // stored size (1/1000 of raw).
+    PutStatusU32(&usb_buf[55], GetLzCyclesPerByte());    // 1/100 cycles.
+    PutStatusU16(&usb_buf[59], GetFlashLzRestarts());
+    usb_buf[61] = _isSramUploadFailed;    // sram upload did not fit.
+}
+
+// Status page 3: nvm animation library.
+static void PutStatusPage3(uint8_t *usb_buf)
+{
+    // Send slot usage to host:
+    usb_buf[3] = NVM_SLOTS;
+    usb_buf[4] = GetNvmActiveSlot();    // NVM_SLOT_NONE if no slot is selected.
+    usb_buf[5] = GetNvmBootSlot();
+    PutStatusU16(&usb_buf[6], GetNvmSlotMask());    // bit per used slot.
+    usb_buf[8] = _isNvmAppendFailed;
+    PutStatusU32(&usb_buf[9], _u32SlotSwitchCycles);
+    PutStatusU32(&usb_buf[13], GetNvmAnimationLength());    // of active slot.
+
+    // Send name hashes of slots to host:
+    uint8_t i;
+    for (i = 0; i < NVM_SLOTS; i++) PutStatusU32(&usb_buf[17 + 4 * i], GetNvmSlotNameHash(i));
+}
+
+// Decode one animation step into the led frame ring, returns false once the animation has ended:
+static bool RenderAnimationFrame(void)
+{
+    if (_isAnimationEnded) return false;
+
+    uint32_t decodeStartCycles = GetCycleCount();
+    _isAnimationEnded = !RunAnimation(isSaveToRom);
+    if (isSaveToRom) _u32DecodeCyclesNvm = GetCyclesElapsed(decodeStartCycles);
+    else _u32DecodeCyclesSram = GetCyclesElapsed(decodeStartCycles);
+
+    PushLedFrame();    // one ring frame per step, also when the decoder left the leds unchanged.
+    return !_isAnimationEnded;
+}
+
+// Account for ticks missed by the previous frame and apply overrun policy:
+static void HandleFrameOverrun(uint8_t missedTicks)
+{
+    _u16OverrunCount++;
+    if (missedTicks > _u8OverrunMaxTicks) _u8OverrunMaxTicks = missedTicks;
+
+    if (_overrunPolicy == OverrunCatchUp)
+    {
+        uint16_t backlogMax = TICK_BACKLOG_MAX_US / GetTickIntervalUs();
+        _u16TickBacklog += missedTicks;
+        if (_u16TickBacklog > backlogMax) _u16TickBacklog = backlogMax;    // render cannot keep up with the tick.
+    }
+    else
+    {
+        _u8SkipTicks = missedTicks;
     }
 }
 
 static void UsbOutputReportCallback (uint8_t *usb_buf, uint16_t usb_buffer_len)
 {
     (void)usb_buffer_len;
-	// Send status flags to host:
+	// Send status flags to host (same on all pages):
     usb_buf[0] = isActiveAnimation;
-    usb_buf[1] = isActiveMemWrite;
+    usb_buf[1] = isActiveMemWrite || GetUsbPacketCount() || IsNvmBusy();    // storage continues after last packet is received.
     usb_buf[2] = packetFlag;
+
+    // Send selected status page:
+    memset(&usb_buf[3], 0, STATUS_PAGE_BYTE - 3);
+    if (_u8StatusPage == 1) PutStatusPage1(usb_buf);
+    else if (_u8StatusPage == 2) PutStatusPage2(usb_buf);
+    else if (_u8StatusPage == 3) PutStatusPage3(usb_buf);
+    else PutStatusPage0(usb_buf);
+    usb_buf[STATUS_PAGE_BYTE] = _u8StatusPage;
 }
 
 #pragma endregion
@@ -169,15 +861,31 @@ int main(void)
     // Watchdog init:
     WdtInit();
 
+    // Cycle counter init (performance measurements):
+    CycleCounterInit();
+
+    // Rtc init (low-power playback timebase):
+    RtcInit();
+
+    // Asynchronous nvm engine init:
+    NvmJobsInit();
+
+    // Load animation library index:
+    NvmLibraryInit();
+
 	// Enable led power supply:
 	LedPowerInit();
 
+    // Led output backend init:
+    LedOutputInit();
+
     // Add timer task:
     TimerAddTask(10);    // set arbitrary initial value for tick interval.
-    timer_start(&TIMER_0);
+    timer_start(&TIMER_0);    // keeps running, stands in for missing sofs.
 
     // Initialize usb:
     bool isHidGenericEnabled = false;
+    bool isVendorEnabled = false;
     hid_generic_init();
     usbdc_register_handler(USBDC_HDL_SOF, &_structUsbSofEvent);
 
@@ -190,8 +898,8 @@ int main(void)
     volatile uint8_t rstReason = _get_reset_reason();
     if (rstReason != RESET_REASON_WDT)
 	{
-		// Initiate boot-up check for an nvm-stored animation (sram is blank after reset):
-		isSaveToRom = true;
+		// Initiate boot-up check for an nvm-stored animation (sram is blank after reset, an animation that fits is played from a copy):
+		isSaveToRom = !CacheNvmAnimation();
 		animationFlag = RunInit;
 	}
     /*
@@ -212,21 +920,104 @@ int main(void)
         // Reset watchdog:
         wdt_feed(&WDT_0);
 
+        // Process packets received by usb interrupt (control packets first, they may start a store sequence):
+        DrainUsbPackets();
+        DrainUsbBulk();
+        DrainUsbPackets();    // break packet waiting for bulk data.
+
+        // Latch live frames on next usb frame:
+        if (packetFlag == LiveFlag) LatchLiveFrame();
+
+        // Take upload time once last byte has been programmed:
+        if (_isUploadFinishing && !IsNvmBusy())
+        {
+            _isUploadFinishing = false;
+            _u32UploadMs = GetMsCount() - _u32UploadStartMs;
+        }
+
+        // Record stored animation in a library slot (only if programmed completely and without errors):
+        if (_isNvmAppendPending && !IsNvmBusy())
+        {
+            _isNvmAppendPending = false;
+            if (_isNvmAppendFailed || GetNvmJobErrorCount()
+                || !NvmAppendFinish(_u32NvmAppendAddr, ptrNvm - _u32NvmAppendAddr, _isUploadCompressed, _uploadLz.outPos, _u32UploadNameHash))
+            {
+                _isNvmAppendFailed = true;
+            }
+        }
+
         // Implement non-blocking hid initialization:
         if (!isHidGenericEnabled && hiddf_generic_is_enabled())
         {
             isHidGenericEnabled = true; // hiddf_generic_is_enabled() always returns true once enabled even if host is disconnected.
-            timer_stop(&TIMER_0);   // turn off timer since sof is running.
             hiddf_generic_register_callback(HIDDF_GENERIC_CB_GET_CTRL_REPORT, (FUNC_PTR)UsbInputReportCallback);
             hiddf_generic_register_callback(HIDDF_GENERIC_CB_SET_CTRL_REPORT, (FUNC_PTR)UsbOutputReportCallback);
+            hiddf_generic_register_callback(HIDDF_GENERIC_CB_READ, (FUNC_PTR)UsbOutEndpointCallback);
+        }
+
+        // Re-arm interrupt out endpoint once ring has been drained (or after bus reset):
+        if (isHidGenericEnabled && !_isUsbOutArmed)
+        {
+            CRITICAL_SECTION_ENTER();
+            ArmUsbOutEndpoint();
+            CRITICAL_SECTION_LEAVE();
+        }
+
+        // Vendor bulk interface is enabled independently by usb stack:
+        if (!isVendorEnabled && vendordf_is_enabled())
+        {
+            isVendorEnabled = true;
+            vendordf_register_callback(VENDORDF_CB_READ, (FUNC_PTR)UsbBulkOutCallback);
+        }
+
+        // Re-arm bulk out endpoint once a buffer has been stored (or after bus reset):
+        if (isVendorEnabled && !_isUsbBulkArmed)
+        {
+            CRITICAL_SECTION_ENTER();
+            ArmUsbBulkEndpoint();
+            CRITICAL_SECTION_LEAVE();
         }
 
         if (animationFlag == RunInit)
         {
+            if (isSaveToRom && IsNvmBusy()) continue;    // wait for queued nvm programming to complete.
+
+            // Nvm playback needs a library slot (empty library, deleted active slot or nvm of the single-animation layout):
+            if (isSaveToRom && GetNvmActiveSlot() == NVM_SLOT_NONE)
+            {
+                animationFlag = Stop;
+                continue;
+            }
+
             isActiveAnimation = true;
+
+            // Reset overrun counters of new animation:
+            _u16TickBacklog = 0;
+            _u8SkipTicks = 0;
+            _u16OverrunCount = 0;
+            _u8OverrunMaxTicks = 0;
+            _u32SkippedFrames = 0;
+            _u32CaughtUpFrames = 0;
+            FlashReadReset();
+            if (isSaveToRom) LzResetStats();    // decompression cost of nvm playback.
+
+            // Reset render-ahead counters of new animation:
+            _isAnimationEnded = false;
+            _u8LedFrameLead = 0;
+            _u8LedFrameLeadMin = GetLedFrameRingSize();
+            _u16RenderUnderruns = 0;
+            while (GetLedFrameLead()) DropLedFrame();    // frames of a previous animation still rendered ahead.
+
 	        if (InitAnimation(isSaveToRom))
             {
                 animationFlag = Run;
+
+                // Fill led frame ring ahead of the first tick:
+                SetLedFramePipeline(true);
+                while (!IsLedFrameRingFull() && RenderAnimationFrame());
+
+                // Arm first tick (ticks issued while stopped are not overruns, synchronized ticks keep their phase):
+                if (!IsSyncTicks()) ResetElapsedTicks();
             }
             else
             {
@@ -237,20 +1028,73 @@ int main(void)
         {
             isActiveAnimation = true;
 
-            // Pause until next tick:
-            WaitForIntervalElapse();
+            // Take ticks from rtc while a stored animation (from nvm or its sram cache) plays without usb host (handed back
+            // when sofs return):
+            bool isRtcTicks = _isLowPowerPlayback && (isSaveToRom || _isNvmCached) && IsTimerTimebase();
+            if (isRtcTicks && !IsRtcTimebase()) StartRtcTicks();
+            else if (!isRtcTicks && IsRtcTimebase()) StopRtcTicks();
+
+            // Pause until next tick (frames of missed ticks are caught up without pausing):
+            if (_u16TickBacklog)
+            {
+                _u16TickBacklog--;
+                _u32CaughtUpFrames++;
+            }
+            else
+            {
+                uint8_t elapsedTicks = WaitForIntervalElapse();
+                if (elapsedTicks > 1) HandleFrameOverrun(elapsedTicks - 1);
+            }
+
+            RequestPerfLevel(PerfLevelFull);
+            SetLedFramePipeline(true);
+
+            // Drop frames of skipped ticks (decoded now if they were not rendered ahead):
+            _u8LedFrameLead = GetLedFrameLead();
+            while (_u8SkipTicks)
+            {
+                if (!GetLedFrameLead()) RenderAnimationFrame();
+                DropLedFrame();
+                _u32SkippedFrames++;
+                _u8SkipTicks--;
+            }
+
+            // Output frame rendered ahead for this tick (fixed phase from tick), decoded late on an underrun:
+            if (_u8LedFrameLead < _u8LedFrameLeadMin) _u8LedFrameLeadMin = _u8LedFrameLead;
+            if (!GetLedFrameLead() && !_isAnimationEnded)
+            {
+                _u16RenderUnderruns++;
+                RenderAnimationFrame();
+            }
+            PresentLedFrame();
+            if (_isAnimationEnded && !GetLedFrameLead()) animationFlag = Stop;
 
 	        //gpio_set_pin_level(EXT_LED_DATA_PIN, OFF);    // debugging.
 
-            if (!RunAnimation(isSaveToRom))
+            // Render ahead in the slack before the next tick (yields as soon as a tick is due):
+            while (!_isAnimationEnded && !IsLedFrameRingFull() && !_u16TickBacklog && !IsTickElapsed())
             {
-                animationFlag = Stop;
+                RenderAnimationFrame();
             }
 
             //gpio_set_pin_level(EXT_LED_DATA_PIN, ON);    // debugging.
         }
 
+        // Present frames immediately when no animation is running and no live frames are streamed:
+        if (animationFlag != Run && packetFlag != LiveFlag) SetLedFramePipeline(false);
+        if (animationFlag != Run) StopRtcTicks();
+
+        // Cpu clock until next loop (decode requests full clock, stopped animation with control traffic only needs little):
+        if (animationFlag == Run) RequestPerfLevel(PerfLevelMid);
+        else if (animationFlag == Stop && packetFlag == ControlFlag) RequestPerfLevel(PerfLevelLow);
+        else RequestPerfLevel(PerfLevelFull);
+
         isActiveAnimation = false;
+
+        // Sleep until next interrupt (usb, sof/timer every 1ms, nvm) while there is nothing to do:
+        CRITICAL_SECTION_ENTER();
+        if (animationFlag == Stop && !GetUsbPacketCount() && !IsUsbBulkPending() && !_isUsbBreakPending) IdleSleep();
+        CRITICAL_SECTION_LEAVE();
     }
 #pragma endregion
 }
\ No newline at end of file
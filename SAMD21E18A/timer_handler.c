@@ -18,53 +18,763 @@
  */
 
 #include "driver_init.h"
+#include <hpl_gclk_base.h>
+#include <hpl_pm_base.h>
+#include <hpl_tc_base.h>
+#include <hpl_tc_config.h>
+#include <peripheral_clk_config.h>
+#include "timer_handler.h"
+#include "ledstrip_driver.h"
+
+#define SOF_TIMEOUT_MS 3    // missing sofs before the timer is reported as timebase.
+#define TIMER_COUNTS_PER_US (CONF_GCLK_TC3_FREQUENCY / CONF_TC3_PRESCALE / 1000000)    // tc3 runs at 6MHz.
+#define TICK_COMPARE_MIN_US 10    // ticks closer to the millisecond boundary are issued directly.
+#define TICK_PACING_MAX_US 300000    // longer intervals exceed the cycle counter range.
+#define CYCLES_PER_US (CONF_CPU_FREQUENCY / 1000000)
+#define IDLE_SLEEP_MODE PM_SLEEP_IDLE_CPU_Val    // cpu clock stopped, usb, dma, tc3 and nvmctrl keep running.
+#define IDLE_WINDOW_MS 1000    // minimum, windows are timed by the rtc and closed by sof/timer or rtc tick events.
+#define STANDBY_SLEEP_MODE 3    // deep sleep: gclk0/dfll stop, rtc keeps running from gclk1 (osculp32k).
+#define RTC_COMPARE_MARGIN 4    // rtc counts (122us), covers compare register synchronization.
+#define WAKE_LATENCY_MAX_US 1000    // standby is given up for idle when wake-to-output latency exceeds this.
+#define RTC_NOMINAL_HZ 32768
+#define RTC_CAL_SOFS 1000    // sofs per calibration window (rtc counts per window = rtc frequency in Hz).
+#define RTC_CAL_TOLERANCE_HZ (RTC_NOMINAL_HZ / 4)    // implausible windows (e.g. delayed sof interrupts) are discarded.
+#define PERF_LEVELS 3
+#define PERF_SLEEP_DIV 4    // gclk0 division while sleeping (usb needs a bus clock of at least 8MHz).
+#define PERF_VDD_MV 3300
+#define PERF_SLEEP_UA 600    // idle sleep current at 12MHz bus clock.
+#define PERF_STANDBY_UA 5    // standby current (dfll stopped, rtc on osculp32k).
 
 static struct timer_task _structTimer0Task;
-static uint16_t _u16SofMsCounter;
+static uint16_t _u16LastFrameNum;
 
-static uint16_t _tickIntervalMs;
+static volatile uint32_t _u32TickIntervalUs = 1000;    // whole microseconds of the tick period.
+static volatile uint32_t _u32TickIntervalRem;    // fraction of the tick period in 1/_u32TickIntervalDen us.
+static volatile uint32_t _u32TickIntervalDen = 1;
 static volatile uint8_t u8ElapsedTicks; // volatile critical.
+static volatile uint32_t _u32MsCount;    // free-running millisecond count (usb sof or timer).
+
+// Microsecond tick scheduler (tc3 is restarted by every sof, ticks inside a millisecond are placed by its compare channel 1):
+static uint32_t _u32TickDueUs;    // next tick from start of current millisecond (whole us, truncated).
+static uint32_t _u32TickDueRem;    // fraction of next tick time truncated from _u32TickDueUs/_u64RtcTickDueUs (1/den us).
+static uint32_t _u32PacingRem;    // fraction of nominal interval carried between pacing measurements (1/den us).
+static volatile bool _isTickCompareArmed;
+static volatile uint32_t _u32TickCount;
+static uint32_t _u32LastTickCycles;
+static bool _isLastTickValid;
+static volatile int32_t _i32TickPacingErrorUs;    // measured minus nominal interval of last tick.
+static volatile uint32_t _u32TickPacingErrorMaxUs;    // largest absolute pacing error.
+static volatile int32_t _i32TickPacingDriftUs;    // sum of pacing errors (stays bounded while tick rate is exact).
+
+// Frame-synchronized ticks (boards on the same bus see the same usb frame numbers):
+static volatile uint32_t _u32FrameCount;    // usb frame number extended to 32 bits (counts missed sofs).
+static volatile bool _isSyncArmed;    // ticks are phased from a usb frame number.
+static volatile bool _isSyncPending;    // sync start frame not yet processed.
+static volatile uint32_t _u32SyncStartFrame;    // extended frame of first tick.
+static volatile uint32_t _u32LastTickFrame;
+static volatile uint32_t _u32SyncSofCount;    // sof interrupts since first tick.
+static uint16_t _u16SyncPhaseError;    // frames between last tick and start of its render.
+static uint16_t _u16SyncPhaseErrorMax;
+
+// Timebase failover (timer period is restarted by every sof, so it only expires in place of a missing sof):
+static volatile bool _isTimerTimebase = true;    // no sof received yet.
+static volatile uint8_t _u8MissedSofs;    // consecutive milliseconds counted by timer.
+static volatile uint32_t _u32TimerEventCycles;
+static volatile uint32_t _u32SofEventCycles;
+static volatile uint16_t _u16SofToTimerCount;
+static volatile uint16_t _u16TimerToSofCount;
+static volatile uint32_t _u32TimerMsCount;    // milliseconds counted by timer.
+
+// Idle time (cpu cycles are only counted while awake, sof/timer wakes the cpu at least every 1ms, rtc ticks during low-power playback):
+static uint32_t _u32ActiveStartCycles;    // start of current awake period.
+static uint32_t _u32ActiveCycles;    // awake cycles of current window.
+static uint32_t _u32IdleWindowStartCount;    // rtc count at start of current window.
+static uint32_t _u32StandbyCounts;    // rtc counts spent in standby in current window.
+static volatile uint16_t _u16IdlePermille;    // idle time of last window.
+static volatile uint32_t _u32ActiveCyclesPerSec;
+
+// Low-power playback (rtc ticks while no usb host is present, cpu sleeps in standby between frames):
+static volatile bool _isRtcTimebase;
+static uint64_t _u64RtcTickDueUs;    // time of next tick in rtc microseconds (fraction is carried in _u32TickDueRem).
+static uint32_t _u32RtcLastTickCount;
+static volatile uint32_t _u32RtcWakeDueCount;    // rtc count of tick that ended the last sleep.
+static uint16_t _u16WakeLatencyUs;    // rtc compare to return from WaitForIntervalElapse().
+static uint16_t _u16WakeLatencyMaxUs;
+static uint32_t _u32StandbyCount;
+static bool _isStandbyDisabled;    // wake latency exceeded WAKE_LATENCY_MAX_US.
+static volatile uint32_t _u32RtcFreqHz = RTC_NOMINAL_HZ;    // osculp32k (several % tolerance) calibrated against usb sofs.
+static uint16_t _u16RtcCalSofs;    // consecutive sofs of current calibration window.
+static uint32_t _u32RtcCalStartCount;
+
+// Clock governor (gclk0 = cpu/bus clock is divided while idle, usb, tc3 and led spi run from gclk2 at 48MHz):
+static const uint8_t _perfLevelDiv[PERF_LEVELS] = {4, 2, 1};
+static const uint16_t _perfLevelMicroAmps[PERF_LEVELS] = {1300, 2100, 3600};    // typical active currents (dfll48m running).
+static enum PerfLevel _perfLevel = PerfLevelFull;    // level while awake.
+static uint8_t _u8ClockDiv = 1;    // current gclk0 division.
+static uint32_t _u32ClockDivStartRaw;    // systick count at last division change.
+static uint32_t _u32CycleOffset;    // 48MHz cycles systick did not count while gclk0 was divided.
+static uint32_t _u32PerfLevelCycles[PERF_LEVELS];    // awake time per level of current window (48MHz cycles).
+static uint16_t _u16PerfLevelPermille[PERF_LEVELS];    // awake time per level of last window.
+static uint32_t _u32WindowTickCount;
+static volatile uint32_t _u32FrameEnergyNj;    // estimated energy per tick of last window.
+static volatile uint32_t _u32AveragePowerUw;
 //static bool level;  // debug.
 
-void WaitForIntervalElapse()
+// Rtc conversions use the calibrated frequency (only updated while the rtc is not the timebase):
+static uint64_t RtcCountsToUs(uint32_t counts)
+{
+    return (uint64_t)counts * 1000000 / _u32RtcFreqHz;
+}
+
+static uint32_t RtcUsToCounts(uint64_t us)
+{
+    return us * _u32RtcFreqHz / 1000000;    // wraps with the 32-bit rtc counter.
+}
+
+// Returns the number of ticks elapsed since last call (more than 1 when the previous frame overran its tick):
+uint8_t WaitForIntervalElapse()
+{
+    uint8_t elapsedTicks = 0;
+
+    // Sleep until a minimum of 1-tick has elapsed:
+    while (elapsedTicks == 0)
+    {
+        CRITICAL_SECTION_ENTER();
+        elapsedTicks = u8ElapsedTicks;
+        u8ElapsedTicks = 0;   // reset tick counter.
+        if (elapsedTicks == 0) IdleSleep();
+        CRITICAL_SECTION_LEAVE();
+    }
+
+    // Measure latency from rtc tick to frame output (wake-up from standby restarts the dfll):
+    if (_isRtcTimebase)
+    {
+        uint64_t latencyUs = RtcCountsToUs(hri_rtcmode0_read_COUNT_reg(RTC) - _u32RtcWakeDueCount);
+        _u16WakeLatencyUs = latencyUs < 0xFFFF ? latencyUs : 0xFFFF;
+        if (_u16WakeLatencyUs > _u16WakeLatencyMaxUs) _u16WakeLatencyMaxUs = _u16WakeLatencyUs;
+        if (_u16WakeLatencyUs > WAKE_LATENCY_MAX_US) _isStandbyDisabled = true;    // keeps frame pacing within 1ms.
+    }
+
+    if (_isSyncArmed)
+    {
+        _u16SyncPhaseError = _u32FrameCount - _u32LastTickFrame;
+        if (_u16SyncPhaseError > _u16SyncPhaseErrorMax) _u16SyncPhaseErrorMax = _u16SyncPhaseError;
+    }
+
+    return elapsedTicks;
+}
+
+// Check without waiting whether a tick is due (work ahead of the tick should yield):
+bool IsTickElapsed(void)
+{
+    return u8ElapsedTicks != 0;
+}
+
+static uint32_t GetRawCycleCount(void)
+{
+    return SysTick_LOAD_RELOAD_Msk - SysTick->VAL;    // systick counts down.
+}
+
+// Change gclk0 division, returns time spent at previous division in 48MHz cycles. Call with interrupts masked:
+static uint32_t SetClockDiv(uint8_t div)
+{
+    uint32_t raw = GetRawCycleCount();
+    uint32_t rawCycles = (raw - _u32ClockDivStartRaw) & SysTick_LOAD_RELOAD_Msk;
+
+    _u32CycleOffset += rawCycles * (_u8ClockDiv - 1);
+    _u32ClockDivStartRaw = raw;
+
+    uint32_t cycles = rawCycles * _u8ClockDiv;
+    if (div != _u8ClockDiv)
+    {
+        hri_gclk_write_GENDIV_reg(GCLK, GCLK_GENDIV_ID(0) | GCLK_GENDIV_DIV(div));
+        hri_gclk_wait_for_sync(GCLK);
+        _u8ClockDiv = div;
+    }
+    return cycles;
+}
+
+// Sleep until next interrupt. Call with interrupts masked after checking the wake condition
+// (a pending interrupt still ends the sleep, so no wake-up is missed between check and sleep):
+void IdleSleep(void)
+{
+    // Standby only between rtc ticks (sof and tc3 need gclk0) and once led output is complete:
+    bool isStandby = _isRtcTimebase && !_isStandbyDisabled && !IsLedOutputBusy();
+
+    _u32ActiveCycles += GetCyclesElapsed(_u32ActiveStartCycles);
+    _u32PerfLevelCycles[_perfLevel] += SetClockDiv(PERF_SLEEP_DIV);
+    uint32_t sleepCount = hri_rtcmode0_read_COUNT_reg(RTC);
+    sleep(isStandby ? STANDBY_SLEEP_MODE : IDLE_SLEEP_MODE);
+    if (isStandby) _u32StandbyCounts += hri_rtcmode0_read_COUNT_reg(RTC) - sleepCount;    // systick is stopped in standby.
+    SetClockDiv(_perfLevelDiv[_perfLevel]);    // interrupts pending from wake-up run at requested level.
+    _u32ActiveStartCycles = GetCycleCount();
+
+    if (isStandby) _u32StandbyCount++;
+}
+
+// Set cpu clock level for the work between sleeps (sleeping always drops to PERF_SLEEP_DIV):
+void RequestPerfLevel(enum PerfLevel level)
+{
+    if (level == _perfLevel) return;
+
+    CRITICAL_SECTION_ENTER();
+    _u32PerfLevelCycles[_perfLevel] += SetClockDiv(_perfLevelDiv[level]);
+    _perfLevel = level;
+    CRITICAL_SECTION_LEAVE();
+}
+
+enum PerfLevel GetPerfLevel(void)
+{
+    return _perfLevel;
+}
+
+uint16_t GetPerfLevelPermille(enum PerfLevel level)
+{
+    return _u16PerfLevelPermille[level];
+}
+
+// Returns nJ per tick (frame) of last window:
+uint32_t GetFrameEnergy(void)
+{
+    return _u32FrameEnergyNj;
+}
+
+uint32_t GetAveragePower(void)
+{
+    return _u32AveragePowerUw;
+}
+
+// Close idle measurement window once IDLE_WINDOW_MS have passed on the rtc (interrupts only run while the cpu is awake,
+// so the current awake period is open). Called from sof/timer and rtc tick events:
+static void UpdateIdleWindow(void)
+{
+    uint32_t count = hri_rtcmode0_read_COUNT_reg(RTC);
+    uint32_t windowMs = RtcCountsToUs(count - _u32IdleWindowStartCount) / 1000;
+    if (windowMs < IDLE_WINDOW_MS) return;
+    _u32IdleWindowStartCount = count;
+
+    _u32ActiveCycles += GetCyclesElapsed(_u32ActiveStartCycles);
+    _u32ActiveStartCycles = GetCycleCount();
+    _u32PerfLevelCycles[_perfLevel] += SetClockDiv(_u8ClockDiv);
+
+    // Estimate energy from time spent at each level and in standby (idle sleep is the remainder of the window):
+    uint64_t windowCycles = (uint64_t)CONF_CPU_FREQUENCY / 1000 * windowMs;
+    uint64_t standbyCycles = RtcCountsToUs(_u32StandbyCounts) * CYCLES_PER_US;
+    uint64_t sleepCycles = windowCycles > standbyCycles ? windowCycles - standbyCycles : 0;
+    uint64_t chargeCycles = 0;    // uA x 48MHz cycles.
+    uint8_t i;
+    for (i = 0; i < PERF_LEVELS; i++)
+    {
+        uint32_t permille = (uint64_t)_u32PerfLevelCycles[i] * 1000 / windowCycles;
+        sleepCycles = sleepCycles > _u32PerfLevelCycles[i] ? sleepCycles - _u32PerfLevelCycles[i] : 0;
+        chargeCycles += (uint64_t)_u32PerfLevelCycles[i] * _perfLevelMicroAmps[i];
+        _u16PerfLevelPermille[i] = permille < 1000 ? permille : 1000;
+        _u32PerfLevelCycles[i] = 0;
+    }
+    chargeCycles += sleepCycles * PERF_SLEEP_UA + standbyCycles * PERF_STANDBY_UA;
+    _u32StandbyCounts = 0;
+
+    uint32_t energyNj = chargeCycles * PERF_VDD_MV / (CONF_CPU_FREQUENCY / 1000 * 1000);
+    uint32_t ticks = _u32TickCount - _u32WindowTickCount;
+    _u32WindowTickCount = _u32TickCount;
+    _u32FrameEnergyNj = ticks ? energyNj / ticks : 0;
+    _u32AveragePowerUw = energyNj / windowMs;
+
+    uint32_t activePermille = (uint64_t)_u32ActiveCycles * 1000 / windowCycles;
+    _u16IdlePermille = activePermille < 1000 ? 1000 - activePermille : 0;
+    _u32ActiveCyclesPerSec = (uint64_t)_u32ActiveCycles * 1000 / windowMs;
+    _u32ActiveCycles = 0;
+}
+
+uint16_t GetIdlePermille(void)
+{
+    return _u16IdlePermille;
+}
+
+uint32_t GetActiveCyclesPerSec(void)
+{
+    return _u32ActiveCyclesPerSec;
+}
+
+// Whole microseconds of the next tick period, carrying the fraction of the period in *pu32Rem:
+static uint32_t StepTickInterval(uint32_t *pu32Rem)
+{
+    *pu32Rem += _u32TickIntervalRem;
+    if (*pu32Rem < _u32TickIntervalDen) return _u32TickIntervalUs;
+    *pu32Rem -= _u32TickIntervalDen;
+    return _u32TickIntervalUs + 1;
+}
+
+// Undo the last StepTickInterval() on *pu32Rem, returns the whole microseconds it stepped:
+static uint32_t UnstepTickInterval(uint32_t *pu32Rem)
+{
+    if (*pu32Rem >= _u32TickIntervalRem)
+    {
+        *pu32Rem -= _u32TickIntervalRem;
+        return _u32TickIntervalUs;
+    }
+    *pu32Rem += _u32TickIntervalDen - _u32TickIntervalRem;
+    return _u32TickIntervalUs + 1;
+}
+
+// Compare measured tick interval with the nominal interval (drift does not grow from the fraction of the period):
+static void RecordTickPacing(uint32_t intervalUs)
+{
+    int32_t errorUs = (int32_t)intervalUs - (int32_t)StepTickInterval(&_u32PacingRem);
+    uint32_t absErrorUs = errorUs < 0 ? -errorUs : errorUs;
+
+    _i32TickPacingErrorUs = errorUs;
+    _i32TickPacingDriftUs += errorUs;
+    if (absErrorUs > _u32TickPacingErrorMaxUs) _u32TickPacingErrorMaxUs = absErrorUs;
+}
+
+// Signal tick to main loop:
+static void IssueTick(void)
+{
+    _u32LastTickFrame = _u32FrameCount;
+    _u32TickCount++;
+    if (u8ElapsedTicks < 0xFF) u8ElapsedTicks++;
+
+    //gpio_set_pin_level(EXT_LED_DATA_PIN, level = !level);    // debugging.
+}
+
+// Issue tick of sof/tc3 timebase, pacing is measured with the cycle counter:
+static void IssueTimerTick(void)
+{
+    uint32_t cycles = GetCycleCount();
+
+    if (_isLastTickValid && _u32TickIntervalUs < TICK_PACING_MAX_US)
+    {
+        RecordTickPacing(((cycles - _u32LastTickCycles) & SysTick_LOAD_RELOAD_Msk) / CYCLES_PER_US);
+    }
+    _u32LastTickCycles = cycles;
+    _isLastTickValid = true;
+
+    IssueTick();
+}
+
+// Rtc runs from gclk1 (osculp32k, kept running in standby) as a free-running 32-bit counter:
+void RtcInit(void)
+{
+    _pm_enable_bus_clock(PM_BUS_APBA, RTC);
+    _gclk_enable_channel(RTC_GCLK_ID, GCLK_CLKCTRL_GEN_GCLK1_Val);
+
+    hri_rtcmode0_write_CTRL_reg(RTC, RTC_MODE0_CTRL_SWRST);
+    hri_rtcmode0_write_CTRL_reg(RTC, RTC_MODE0_CTRL_MODE_COUNT32 | RTC_MODE0_CTRL_PRESCALER_DIV1);
+    hri_rtc_write_READREQ_reg(RTC, RTC_READREQ_RCONT | RTC_READREQ_RREQ | RTC_READREQ_ADDR(RTC_MODE0_COUNT_OFFSET));
+    hri_rtcmode0_write_CTRL_reg(RTC, RTC_MODE0_CTRL_MODE_COUNT32 | RTC_MODE0_CTRL_PRESCALER_DIV1 | RTC_MODE0_CTRL_ENABLE);
+
+    NVIC_ClearPendingIRQ(RTC_IRQn);
+    NVIC_EnableIRQ(RTC_IRQn);
+
+    _u32IdleWindowStartCount = hri_rtcmode0_read_COUNT_reg(RTC);
+}
+
+// Measure rtc frequency over windows of consecutive sofs (the dfll and usb frames are locked to the host clock).
+// Called from every sof, isConsecutive is false after missed sofs:
+static void CalibrateRtc(bool isConsecutive)
+{
+    uint32_t count = hri_rtcmode0_read_COUNT_reg(RTC);
+
+    if (!isConsecutive || _isRtcTimebase)
+    {
+        _u16RtcCalSofs = 0;
+        _u32RtcCalStartCount = count;
+        return;
+    }
+    if (++_u16RtcCalSofs < RTC_CAL_SOFS) return;
+
+    uint32_t freqHz = (count - _u32RtcCalStartCount) * (1000 / RTC_CAL_SOFS);
+    if (freqHz > RTC_NOMINAL_HZ - RTC_CAL_TOLERANCE_HZ && freqHz < RTC_NOMINAL_HZ + RTC_CAL_TOLERANCE_HZ) _u32RtcFreqHz = freqHz;
+    _u16RtcCalSofs = 0;
+    _u32RtcCalStartCount = count;
+}
+
+uint32_t GetRtcFrequency(void)
+{
+    return _u32RtcFreqHz;
+}
+
+// Issue rtc tick (and ticks missed by an overrun) and schedule next one. Pacing is measured in rtc counts converted with
+// the sof-calibrated frequency (the error left is interrupt latency and drift since the last calibration):
+void RTC_Handler(void)
+{
+    hri_rtcmode0_clear_interrupt_CMP0_bit(RTC);
+    if (!_isRtcTimebase) return;
+
+    uint32_t count = hri_rtcmode0_read_COUNT_reg(RTC);
+
+    if (_isLastTickValid) RecordTickPacing(RtcCountsToUs(count - _u32RtcLastTickCount));
+    _u32RtcLastTickCount = count;
+    _isLastTickValid = true;
+    _u32RtcWakeDueCount = RtcUsToCounts(_u64RtcTickDueUs);
+
+    while ((int32_t)(count + RTC_COMPARE_MARGIN - RtcUsToCounts(_u64RtcTickDueUs)) >= 0)
+    {
+        IssueTick();
+        _u64RtcTickDueUs += StepTickInterval(&_u32TickDueRem);
+    }
+    hri_rtcmode0_write_COMP_reg(RTC, 0, RtcUsToCounts(_u64RtcTickDueUs));
+
+    UpdateIdleWindow();    // no sof/timer events while the rtc is the timebase.
+}
+
+// Hand ticks over from sof/tc3 to rtc at the current tick phase (tc3 is stopped, it would wake the cpu every 1ms):
+void StartRtcTicks(void)
+{
+    if (_isRtcTimebase) return;
+
+    timer_stop(&TIMER_0);
+
+    CRITICAL_SECTION_ENTER();
+    // Delay to next tick from the tc3 phase (_u32TickDueUs counts from the next millisecond boundary, which is an
+    // overflow still pending when the timer stopped on it):
+    hri_tc_write_READREQ_reg(TC3, TC_READREQ_RREQ | TC_READREQ_ADDR(TC_COUNT16_COUNT_OFFSET));
+    hri_tc_wait_for_sync(TC3);
+    int32_t elapsedUs = hri_tccount16_read_COUNT_reg(TC3) / TIMER_COUNTS_PER_US;
+    int32_t delayUs = (int32_t)_u32TickDueUs + (hri_tc_get_interrupt_OVF_bit(TC3) ? 0 : 1000) - elapsedUs;
+    if (_isTickCompareArmed)
+    {
+        // Tick placed in this millisecond is still due, the rtc takes its interval again once it is issued:
+        hri_tc_clear_INTEN_MC1_bit(TC3);
+        _isTickCompareArmed = false;
+        delayUs -= UnstepTickInterval(&_u32TickDueRem);
+    }
+    if (delayUs < 0) delayUs = 0;
+    _u64RtcTickDueUs = RtcCountsToUs(hri_rtcmode0_read_COUNT_reg(RTC)) + delayUs;
+    _isLastTickValid = false;
+    _u16WakeLatencyMaxUs = 0;
+    _isRtcTimebase = true;
+    hri_rtcmode0_clear_interrupt_CMP0_bit(RTC);
+    hri_rtcmode0_write_COMP_reg(RTC, 0, RtcUsToCounts(_u64RtcTickDueUs));
+    hri_rtcmode0_set_INTEN_CMP0_bit(RTC);
+    CRITICAL_SECTION_LEAVE();
+
+    // Tick may have been due before compare was written:
+    if ((int32_t)(hri_rtcmode0_read_COUNT_reg(RTC) + RTC_COMPARE_MARGIN - RtcUsToCounts(_u64RtcTickDueUs)) >= 0) NVIC_SetPendingIRQ(RTC_IRQn);
+}
+
+// Hand ticks back to sof/tc3 at the current tick phase:
+void StopRtcTicks(void)
+{
+    if (!_isRtcTimebase) return;
+
+    CRITICAL_SECTION_ENTER();
+    hri_rtcmode0_clear_INTEN_CMP0_bit(RTC);
+    _isRtcTimebase = false;
+    int64_t remainingUs = (int64_t)(_u64RtcTickDueUs - RtcCountsToUs(hri_rtcmode0_read_COUNT_reg(RTC)));
+    _u32TickDueUs = remainingUs > 0 ? remainingUs : 0;
+    _isLastTickValid = false;
+    CRITICAL_SECTION_LEAVE();
+
+    timer_start(&TIMER_0);
+}
+
+bool IsRtcTimebase(void)
 {
-    while(u8ElapsedTicks == 0) continue;    // wait until a minimum of 1-tick has elapsed.
-    u8ElapsedTicks = 0;   // reset tick counter.
+    return _isRtcTimebase;
+}
+
+uint16_t GetWakeLatency(void)
+{
+    return _u16WakeLatencyUs;
+}
+
+uint16_t GetWakeLatencyMax(void)
+{
+    return _u16WakeLatencyMaxUs;
+}
+
+uint32_t GetStandbyCount(void)
+{
+    return _u32StandbyCount;
+}
+
+bool IsStandbyDisabled(void)
+{
+    return _isStandbyDisabled;
+}
+
+// Tc3 compare channel 1 reached the microsecond offset of a tick:
+static void TimerCompareEvent(void)
+{
+    hri_tc_clear_INTEN_MC1_bit(TC3);
+    _isTickCompareArmed = false;
+    IssueTimerTick();
+}
+
+// Start ticks of a synchronized animation once the start frame is reached (a start frame in the past keeps its tick phase):
+static bool StartSyncPhase(void)
+{
+    if ((int32_t)(_u32FrameCount - _u32SyncStartFrame) < 0) return false;
+
+    // Tick times are multiples of the period, in 1/den us:
+    uint64_t elapsed = (uint64_t)(_u32FrameCount - _u32SyncStartFrame) * 1000 * _u32TickIntervalDen;
+    uint64_t interval = (uint64_t)_u32TickIntervalUs * _u32TickIntervalDen + _u32TickIntervalRem;
+    _u32TickCount = elapsed ? (elapsed - 1) / interval + 1 : 0;    // ticks already past.
+    uint64_t due = _u32TickCount * interval - elapsed;
+    _u32TickDueUs = due / _u32TickIntervalDen;
+    _u32TickDueRem = due % _u32TickIntervalDen;
+    _isLastTickValid = false;
+    _isSyncPending = false;
+    return true;
+}
+
+// Advance the timebase by one millisecond (from sof, or from timer in place of a missing sof) and schedule a tick due within it:
+static void TimebaseMsEvent(void)
+{
+    _u32MsCount++;
+    UpdateIdleWindow();
+
+    // Compare still armed (sof restarted tc3 before it was reached), tick is due now:
+    if (_isTickCompareArmed) TimerCompareEvent();
+
+    if (_isRtcTimebase) return;    // ticks are scheduled by rtc.
+    if (_isSyncPending && !StartSyncPhase()) return;
+
+    if (_u32TickDueUs < 1000)
+    {
+        if (_u32TickDueUs < TICK_COMPARE_MIN_US)
+        {
+            IssueTimerTick();
+        }
+        else
+        {
+            hri_tc_clear_interrupt_MC1_bit(TC3);
+            hri_tccount16_write_CC_reg(TC3, 1, _u32TickDueUs * TIMER_COUNTS_PER_US);
+            _isTickCompareArmed = true;
+            hri_tc_set_INTEN_MC1_bit(TC3);
+        }
+        _u32TickDueUs += StepTickInterval(&_u32TickDueRem);    // interval is at least 1ms, so at most one tick per millisecond.
+    }
+    _u32TickDueUs -= 1000;
 }
 
 // SOF interrupt is triggered on receipt of sof frame from usb host (every 1ms).
 void UsbSofEvent(void)
 {
-	if (++_u16SofMsCounter > _tickIntervalMs)
+	uint16_t frameNum = usb_d_get_frame_num();
+
+	// Restart timer period at sof phase (disciplines tick placement to the host clock). An overflow latched before the
+	// restart belongs to this millisecond and is discarded:
+	CRITICAL_SECTION_ENTER();
+	hri_tccount16_write_COUNT_reg(TC3, 0);
+	hri_tc_clear_interrupt_OVF_bit(TC3);
+	CRITICAL_SECTION_LEAVE();
+	_u32SofEventCycles = GetCycleCount();
+
+	// Calibrate rtc from consecutive frames only:
+	CalibrateRtc(!_u8MissedSofs && ((frameNum - _u16LastFrameNum) & 0x7FF) == 1);
+
+	if (_u8MissedSofs)
 	{
-		_u16SofMsCounter = 0;
-		u8ElapsedTicks++;
+		// Sof less than half a millisecond after a timer event belongs to the millisecond already counted:
+		bool isSameMs = GetCyclesElapsed(_u32TimerEventCycles) < CONF_CPU_FREQUENCY / 2000;
+
+		if (_isTimerTimebase)
+		{
+			_isTimerTimebase = false;
+			_u16TimerToSofCount++;
+		}
+		_u8MissedSofs = 0;
 
-		//gpio_set_pin_level(EXT_LED_DATA_PIN, level = !level);    // debugging.
+		// Resynchronize frame number predicted by timer:
+		_u16LastFrameNum = (frameNum - (isSameMs ? 0 : 1)) & 0x7FF;
+		if (isSameMs) return;
 	}
+
+	// Extend 11-bit frame number (a frame gap also advances the count):
+	_u32FrameCount += (frameNum - _u16LastFrameNum) & 0x7FF;
+	_u16LastFrameNum = frameNum;
+	if (_isSyncArmed && (int32_t)(_u32FrameCount - _u32SyncStartFrame) >= 0) _u32SyncSofCount++;
+
+	TimebaseMsEvent();
 }
 
-// Timer should only run when sof is down (no usb host connection).
+// Timer expires 1ms after the last sof or timer event, i.e. only while sofs are missing (host suspended or disconnected).
+// Ticks continue at the phase of the last sof:
 void TimerEvent(const struct timer_task *const timer_task)
 {
-	u8ElapsedTicks++;
 	(void)timer_task;
 
-	//gpio_set_pin_level(EXT_LED_DATA_PIN, level = !level);    // debugging.
+	// Timer less than half a millisecond after a sof belongs to the millisecond already counted by the sof:
+	if (!_u8MissedSofs && GetCyclesElapsed(_u32SofEventCycles) < CONF_CPU_FREQUENCY / 2000) return;
+
+	_u32TimerEventCycles = GetCycleCount();
+	_u32FrameCount++;
+	_u16LastFrameNum = (_u16LastFrameNum + 1) & 0x7FF;    // predicted number of missing frame.
+	_u32TimerMsCount++;
+
+	if (_u8MissedSofs < 0xFF) _u8MissedSofs++;
+	if (!_isTimerTimebase && _u8MissedSofs >= SOF_TIMEOUT_MS)
+	{
+		_isTimerTimebase = true;
+		_u16SofToTimerCount++;
+	}
+
+	TimebaseMsEvent();
 }
 
-void TimerAddTask(uint16_t timerIntervalMs)
+bool IsTimerTimebase(void)
 {
-	_structTimer0Task.interval = timerIntervalMs;
-	_structTimer0Task.cb       = TimerEvent;
-	_structTimer0Task.mode     = TIMER_TASK_REPEAT;
-	timer_add_task(&TIMER_0, &_structTimer0Task);
+	return _isTimerTimebase;
+}
+
+uint16_t GetSofToTimerCount(void)
+{
+	return _u16SofToTimerCount;
+}
+
+uint16_t GetTimerToSofCount(void)
+{
+	return _u16TimerToSofCount;
+}
+
+uint32_t GetTimerMsCount(void)
+{
+	return _u32TimerMsCount;
+}
+
+uint32_t GetMsCount(void)
+{
+	return _u32MsCount;
+}
+
+// Phase ticks from usb frame numbers, first tick at 11-bit frame number startFrameNum (a start frame
+// up to 1s in the past is caught up, so all boards keep the same tick phase):
+void StartSyncTicks(uint16_t startFrameNum)
+{
+    CRITICAL_SECTION_ENTER();
+    uint16_t frameDelta = (startFrameNum - _u16LastFrameNum) & 0x7FF;
+    _u32SyncStartFrame = _u32FrameCount + frameDelta - (frameDelta > 1000 ? 0x800 : 0);
+    _u32LastTickFrame = _u32SyncStartFrame;
+    _u32SyncSofCount = (int32_t)(_u32FrameCount - _u32SyncStartFrame) >= 0 ? _u32FrameCount - _u32SyncStartFrame + 1 : 0;
+    _u16SyncPhaseErrorMax = 0;
+    if (_isTickCompareArmed)
+    {
+        hri_tc_clear_INTEN_MC1_bit(TC3);
+        _isTickCompareArmed = false;
+    }
+    u8ElapsedTicks = 0;
+    _isSyncPending = true;
+    _isSyncArmed = true;
+    CRITICAL_SECTION_LEAVE();
+}
+
+// Discard ticks issued while no animation was running (the next tick paces the first frame):
+void ResetElapsedTicks(void)
+{
+    CRITICAL_SECTION_ENTER();
+    u8ElapsedTicks = 0;
+    CRITICAL_SECTION_LEAVE();
+}
+
+void StopSyncTicks(void)
+{
+    _isSyncArmed = false;
+    _isSyncPending = false;
+}
+
+bool IsSyncTicks(void)
+{
+    return _isSyncArmed;
+}
+
+uint32_t GetSyncTickCount(void)
+{
+    return _u32TickCount;
+}
+
+// Sof interrupts minus frames elapsed since first tick (negative when sofs were missed, which a sof counter would drift by):
+int32_t GetSyncDrift(void)
+{
+    if ((int32_t)(_u32FrameCount - _u32SyncStartFrame) < 0) return 0;
+    return (int32_t)(_u32SyncSofCount - (_u32FrameCount - _u32SyncStartFrame + 1));
+}
+
+uint16_t GetSyncPhaseError(void)
+{
+    return _u16SyncPhaseError;
+}
+
+uint16_t GetSyncPhaseErrorMax(void)
+{
+    return _u16SyncPhaseErrorMax;
+}
+
+int32_t GetTickPacingError(void)
+{
+    return _i32TickPacingErrorUs;
+}
+
+uint32_t GetTickPacingErrorMax(void)
+{
+    return _u32TickPacingErrorMaxUs;
+}
+
+int32_t GetTickPacingDrift(void)
+{
+    return _i32TickPacingDriftUs;
+}
+
+uint32_t GetTickIntervalUs(void)
+{
+    return _u32TickIntervalUs;
+}
+
+// Tick period of periodNum/periodDen us (e.g. 1000000/60 for 60fps). The fraction of the period is carried from tick to
+// tick, so ticks do not drift from the rate; each tick is placed at the whole microsecond it falls in:
+void ApplyTickPeriod(uint32_t periodNum, uint32_t periodDen)
+{
+    if (!periodDen) periodDen = 1;
+    uint32_t intervalUs = periodNum / periodDen;
+    uint32_t intervalRem = periodNum % periodDen;
+    if (intervalUs < 1000)    // at most one tick per millisecond.
+    {
+        intervalUs = 1000;
+        intervalRem = 0;
+    }
+    if (intervalUs == _u32TickIntervalUs && (uint64_t)intervalRem * _u32TickIntervalDen == (uint64_t)_u32TickIntervalRem * periodDen) return;
+
+    CRITICAL_SECTION_ENTER();
+    _u32TickIntervalUs = intervalUs;
+    _u32TickIntervalRem = intervalRem;
+    _u32TickIntervalDen = periodDen;
+    _u32TickDueRem = 0;
+    _u32PacingRem = 0;
+    _isLastTickValid = false;
+    _i32TickPacingErrorUs = 0;
+    _u32TickPacingErrorMaxUs = 0;
+    _i32TickPacingDriftUs = 0;
+    CRITICAL_SECTION_LEAVE();
+}
+
+// Period requested by the decoder while frames are rendered ahead is applied when its frame is presented:
+void SetTickPeriod(uint32_t periodNum, uint32_t periodDen)
+{
+    if (IsLedFramePipelineEnabled()) SetLedFrameTickPeriod(periodNum, periodDen);
+    else ApplyTickPeriod(periodNum, periodDen);
+}
+
+void SetTickIntervalUs(uint32_t tickIntervalUs)
+{
+    SetTickPeriod(tickIntervalUs, 1);
 }
 
 void SetTickInterval(uint16_t timerIntervalMs)
 {
-    _tickIntervalMs = timerIntervalMs;
-    _structTimer0Task.interval = timerIntervalMs;
+    SetTickIntervalUs((uint32_t)timerIntervalMs * 1000);
+}
+
+// Timer task runs every timer tick (1ms), ticks are scheduled by TimebaseMsEvent():
+void TimerAddTask(uint16_t timerIntervalMs)
+{
+	SetTickInterval(timerIntervalMs);
+	_tc_timer_register_compare_callback(TimerCompareEvent);
+	_structTimer0Task.interval = 1;
+	_structTimer0Task.cb       = TimerEvent;
+	_structTimer0Task.mode     = TIMER_TASK_REPEAT;
+	timer_add_task(&TIMER_0, &_structTimer0Task);
 }
 
 void WdtInit(void)
@@ -76,3 +786,29 @@ void WdtInit(void)
 	wdt_set_timeout_period(&WDT_0, wdtClkFreq, timeoutPeriodMs);
 	wdt_enable(&WDT_0);
 }
+
+// Systick free-runs from the cpu clock as a 24-bit cycle counter (wraps every 349ms @ 48MHz), no interrupt.
+void CycleCounterInit(void)
+{
+    SysTick->LOAD = SysTick_LOAD_RELOAD_Msk;
+    SysTick->VAL = 0;
+    SysTick->CTRL = SysTick_CTRL_CLKSOURCE_Msk | SysTick_CTRL_ENABLE_Msk;
+}
+
+// Returns 48MHz cycles regardless of cpu clock level:
+uint32_t GetCycleCount(void)
+{
+    uint32_t cycles;
+
+    CRITICAL_SECTION_ENTER();
+    uint32_t raw = GetRawCycleCount();
+    cycles = raw + _u32CycleOffset + ((raw - _u32ClockDivStartRaw) & SysTick_LOAD_RELOAD_Msk) * (_u8ClockDiv - 1);
+    CRITICAL_SECTION_LEAVE();
+
+    return cycles & SysTick_LOAD_RELOAD_Msk;
+}
+
+uint32_t GetCyclesElapsed(uint32_t startCycles)
+{
+    return (GetCycleCount() - startCycles) & SysTick_LOAD_RELOAD_Msk;
+}
@@ -20,13 +20,60 @@
 #ifndef TIMER_HANDLER_H_
 #define TIMER_HANDLER_H_
 
-extern volatile uint8_t u8ElapsedTicks;
+// Cpu clock levels (gclk0), requested by the animation engine for the work between sleeps:
+enum PerfLevel
+{
+    PerfLevelLow = 0,    // 12MHz, usb control traffic only.
+    PerfLevelMid = 1,    // 24MHz.
+    PerfLevelFull = 2,    // 48MHz, decode and led output.
+};
 
-extern void WaitForIntervalElapse();
+extern uint8_t WaitForIntervalElapse();
+extern bool IsTickElapsed(void);
 extern void UsbSofEvent(void);
 extern void TimerEvent(const struct timer_task *const timer_task);
+extern uint32_t GetMsCount(void);
+extern void IdleSleep(void);
+extern uint16_t GetIdlePermille(void);
+extern uint32_t GetActiveCyclesPerSec(void);
+extern bool IsTimerTimebase(void);
+extern void RtcInit(void);
+extern void StartRtcTicks(void);
+extern void StopRtcTicks(void);
+extern bool IsRtcTimebase(void);
+extern uint16_t GetWakeLatency(void);
+extern uint16_t GetWakeLatencyMax(void);
+extern uint32_t GetStandbyCount(void);
+extern bool IsStandbyDisabled(void);
+extern uint32_t GetRtcFrequency(void);
+extern void RequestPerfLevel(enum PerfLevel level);
+extern enum PerfLevel GetPerfLevel(void);
+extern uint16_t GetPerfLevelPermille(enum PerfLevel level);
+extern uint32_t GetFrameEnergy(void);
+extern uint32_t GetAveragePower(void);
+extern uint16_t GetSofToTimerCount(void);
+extern uint16_t GetTimerToSofCount(void);
+extern uint32_t GetTimerMsCount(void);
+extern void StartSyncTicks(uint16_t startFrameNum);
+extern void ResetElapsedTicks(void);
+extern void StopSyncTicks(void);
+extern bool IsSyncTicks(void);
+extern uint32_t GetSyncTickCount(void);
+extern int32_t GetSyncDrift(void);
+extern uint16_t GetSyncPhaseError(void);
+extern uint16_t GetSyncPhaseErrorMax(void);
 extern void TimerAddTask(uint16_t u16TimerIntervalMs);
 extern void SetTickInterval(uint16_t timerIntervalMs);
+extern void SetTickIntervalUs(uint32_t tickIntervalUs);
+extern void SetTickPeriod(uint32_t periodNum, uint32_t periodDen);
+extern void ApplyTickPeriod(uint32_t periodNum, uint32_t periodDen);
+extern uint32_t GetTickIntervalUs(void);
+extern int32_t GetTickPacingError(void);
+extern uint32_t GetTickPacingErrorMax(void);
+extern int32_t GetTickPacingDrift(void);
 extern void WdtInit(void);
+extern void CycleCounterInit(void);
+extern uint32_t GetCycleCount(void);
+extern uint32_t GetCyclesElapsed(uint32_t startCycles);
 
 #endif /* TIMER_HANDLER_H_ */
\ No newline at end of file
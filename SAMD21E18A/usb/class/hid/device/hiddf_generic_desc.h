@@ -58,8 +58,8 @@
 #define HID_GENERIC_IFC_DESC                                                                                           \
 	USB_IFACE_DESC_BYTES(CONF_USB_HID_GENERIC_BIFCNUM, 0x00, 0x02, 0x03, 0x00, 0x00, CONF_USB_HID_GENERIC_IIFC),       \
 	    USB_HID_DESC_BYTES(0x09, 0x21, 0x01, 0x22, CONF_USB_HID_GENERIC_REPORT_LEN),                                   \
-	    USB_ENDP_DESC_BYTES(CONF_USB_HID_GENERIC_INTIN_EPADDR, 0x03, CONF_USB_HID_GENERIC_INTIN_MAXPKSZ, 10),          \
-	    USB_ENDP_DESC_BYTES(CONF_USB_HID_GENERIC_INTOUT_EPADDR, 0x03, CONF_USB_HID_GENERIC_INTOUT_MAXPKSZ, 10)
+	    USB_ENDP_DESC_BYTES(CONF_USB_HID_GENERIC_INTIN_EPADDR, 0x03, CONF_USB_HID_GENERIC_INTIN_MAXPKSZ, CONF_USB_HID_GENERIC_INTIN_BINTERVAL), \
+	    USB_ENDP_DESC_BYTES(CONF_USB_HID_GENERIC_INTOUT_EPADDR, 0x03, CONF_USB_HID_GENERIC_INTOUT_MAXPKSZ, CONF_USB_HID_GENERIC_INTOUT_BINTERVAL)
 
 #define HID_GENERIC_STR_DESCES                                                                                         \
 	CONF_USB_HID_GENERIC_LANGID_DESC                                                                                   \
@@ -10,9 +10,18 @@
 
 static const uint8_t custom_hid_report[] = {CONF_USB_HID_GENERIC_REPORT};
 
+/* Composite configuration: hid generic interface (41 bytes with configuration descriptor) followed by vendor bulk interface. */
+#define COMPOSITE_CFG_DESC                                                                                             \
+	USB_CONFIG_DESC_BYTES(41 + VENDOR_IFC_DESC_LEN,                                                                    \
+	                      2,                                                                                           \
+	                      0x01,                                                                                        \
+	                      CONF_USB_HID_GENERIC_ICONFIG,                                                                \
+	                      CONF_USB_HID_GENERIC_BMATTRI,                                                                \
+	                      CONF_USB_HID_GENERIC_BMAXPOWER)
+
 static uint8_t single_desc_bytes[] = {
     /* Device descriptors and Configuration descriptors list. */
-    HID_GENERIC_DESCES_LS_FS};
+    HID_GENERIC_DEV_DESC, COMPOSITE_CFG_DESC, HID_GENERIC_IFC_DESC, VENDOR_IFC_DESC, HID_GENERIC_STR_DESCES};
 
 static struct usbd_descriptors single_desc[] = {{single_desc_bytes, single_desc_bytes + sizeof(single_desc_bytes)}
 #if CONF_USBD_HS_SP
@@ -39,6 +48,7 @@ void hid_generic_init(void)
 
 	/* usbdc_register_funcion inside */
 	hiddf_generic_init(custom_hid_report, CONF_USB_HID_GENERIC_REPORT_LEN);
+	vendordf_init();
 
 	usbdc_start(single_desc);
 	usbdc_attach();
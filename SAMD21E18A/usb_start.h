@@ -14,6 +14,8 @@ extern "C" {
 
 #include "hiddf_generic.h"
 #include "hiddf_generic_desc.h"
+#include "vendordf.h"
+#include "vendordf_desc.h"
 
 void hid_generic_init(void);
 